@@ -2,16 +2,25 @@
  * @file main.cpp
  * @brief Test driver for universal radix sort implementation with comprehensive
  * tests and performance measurement
+ *
+ * Build: g++ -std=c++17 -O2 -pthread main.cpp -o radix_test
+ * Build once more with -mavx2 to run the same checks through the AVX2
+ * kernels; the driver exits with status 1 if a check fails.
  */
 
 #include "universal_radix_sort.hpp"
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iomanip>
+#include <memory_resource>
 #include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace radix;
@@ -24,12 +33,30 @@ void test_doubles();
 void test_strings();
 void test_strings_descending();
 void test_edge_cases();
+void test_digit_widths();
+void test_write_combining();
+void test_msd_sort();
+void test_unstable_sort();
+void test_descending();
+void test_key_value();
+void test_argsort();
+void test_parallel();
+void test_workspace();
+void test_huge_pages();
+void test_memory_budget();
+void test_external_sort();
+void test_streaming();
+void test_partial_sort();
+void test_selection();
+void test_presorted_input();
 void measure_performance();
 
 struct FixedString {
   char data[11]; // 11 bytes: max_len (10) + null terminator
 };
 
+int failures = 0; // Checks that reported FAILED
+
 int main() {
   cout << "=== UNIVERSAL RADIX SORT TEST SUITE IN C++ ===" << endl;
 
@@ -51,13 +78,333 @@ int main() {
   test_edge_cases();
   cout << "\n------------------------------------------------" << endl;
 
+  test_digit_widths();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_write_combining();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_msd_sort();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_unstable_sort();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_descending();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_key_value();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_argsort();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_parallel();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_workspace();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_huge_pages();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_memory_budget();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_external_sort();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_streaming();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_partial_sort();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_selection();
+  cout << "\n------------------------------------------------" << endl;
+
+  test_presorted_input();
+  cout << "\n------------------------------------------------" << endl;
+
   measure_performance();
   cout << "\n------------------------------------------------" << endl;
 
   cout << "\n=== ALL TESTS COMPLETED ===" << endl;
+  if (failures > 0) {
+    cout << failures << " check(s) FAILED" << endl;
+    return 1;
+  }
   return 0;
 }
 
+/*!
+ * @brief Print the outcome of a check and count it if it failed
+ */
+void report(const string &name, const bool passed) {
+  cout << name << " test: " << (passed ? "PASSED" : "FAILED") << endl;
+  if (!passed) {
+    ++failures;
+  }
+}
+
+/*!
+ * @brief Random keys around zero
+ *
+ * @param n Number of keys
+ * @param distinct Number of distinct keys, small for many ties, or 0 for
+ *                 keys of every magnitude
+ * @param seed Seed of the generator
+ */
+template <typename T>
+vector<T> random_keys(const size_t n, const uint64_t distinct,
+                      const uint64_t seed) {
+  mt19937_64 gen(seed);
+  vector<T> keys(n);
+  for (T &key : keys) {
+    if (distinct != 0) {
+      key = static_cast<T>(gen() % distinct) - static_cast<T>(distinct / 2);
+    } else if (is_floating_point<T>::value) {
+      // Finite values of either sign between 2^-191 and 2^127
+      key = static_cast<T>(
+          ldexp(static_cast<double>(static_cast<int64_t>(gen())),
+                static_cast<int>(gen() % 256) - 191));
+    } else {
+      key = static_cast<T>(gen());
+    }
+  }
+  return keys;
+}
+
+/*!
+ * @brief Order the checks expect, found without the sorter under test
+ */
+template <typename T> bool key_less(const T &a, const T &b) { return a < b; }
+
+/*!
+ * @brief Strings compare up to their terminator, like the radix sort
+ */
+bool key_less(const FixedString &a, const FixedString &b) {
+  return strncmp(a.data, b.data, sizeof(a.data)) < 0;
+}
+
+/*!
+ * @brief Random strings of one to three letters
+ *
+ * The bytes after the terminator tag each string with its position, so
+ * equal strings show whether they kept their input order.
+ *
+ * @param letters Number of letters to draw from, small for many ties
+ */
+vector<FixedString> random_strings(const size_t n, const unsigned letters,
+                                   const uint64_t seed) {
+  mt19937_64 gen(seed);
+  vector<FixedString> strings(n);
+  for (size_t i = 0; i < n; ++i) {
+    FixedString &key = strings[i];
+    memset(key.data, 0, sizeof(key.data));
+    const size_t length = 1 + gen() % 3;
+    for (size_t j = 0; j < length; ++j) {
+      key.data[j] = static_cast<char>('a' + gen() % letters);
+    }
+    const uint32_t position = static_cast<uint32_t>(i);
+    memcpy(key.data + 4, &position, sizeof(position));
+  }
+  return strings;
+}
+
+/*!
+ * @brief Positions of keys in std::stable_sort's order
+ */
+template <typename T>
+vector<size_t> stable_order(const vector<T> &keys, const bool descending) {
+  vector<size_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    order[i] = i;
+  }
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return descending ? key_less(keys[b], keys[a])
+                      : key_less(keys[a], keys[b]);
+  });
+  return order;
+}
+
+/*!
+ * @brief Keys rearranged into an order
+ */
+template <typename T>
+vector<T> permuted(const vector<T> &keys, const vector<size_t> &order) {
+  vector<T> result(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    result[i] = keys[order[i]];
+  }
+  return result;
+}
+
+/*!
+ * @brief Whether two arrays hold the same bytes
+ */
+template <typename T> bool same_bytes(const vector<T> &a, const vector<T> &b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+/*!
+ * @brief Whether a sorter puts keys, alone and with a payload, in an
+ *        expected order, and argsort returns that order
+ *
+ * Unstable sorts (stable false) only have to produce the same keys, with
+ * every payload value still next to its key.
+ *
+ * @param order Positions of the keys in the expected order
+ */
+template <typename Sorter, typename T>
+bool sorts_to(Sorter &sorter, const vector<T> &keys,
+              const vector<size_t> &order, const bool stable = true) {
+  const vector<T> expected = permuted(keys, order);
+  vector<T> sorted = keys;
+  sorter.sort(sorted);
+  if (!same_bytes(sorted, expected)) {
+    return false;
+  }
+
+  // The payload is the position of each key
+  sorted = keys;
+  vector<uint32_t> positions(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    positions[i] = static_cast<uint32_t>(i);
+  }
+  sorter.sort(sorted, positions);
+  if (!same_bytes(sorted, expected)) {
+    return false;
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (stable ? positions[i] != order[i]
+               : memcmp(&sorted[i], &keys[positions[i]], sizeof(T)) != 0) {
+      return false;
+    }
+  }
+
+  // Argsort keeps ties in input order whatever the sorter's stability
+  vector<uint32_t> narrow(keys.size());
+  vector<size_t> wide(keys.size());
+  sorter.argsort(keys.data(), keys.size(), narrow.data());
+  sorter.argsort(keys.data(), keys.size(), wide.data());
+  return wide == order && equal(narrow.begin(), narrow.end(), order.begin());
+}
+
+/*!
+ * @brief Sorter of a key type in a processing order and direction
+ */
+template <typename T, unsigned Bits = default_radix_bits<T>::value>
+UniversalRadixSort<T, Bits> make_sorter(const bool msd,
+                                        const bool descending) {
+  using Sorter = UniversalRadixSort<T, Bits>;
+  return Sorter(msd ? Sorter::ProcessingOrder::MSB_FIRST
+                    : Sorter::ProcessingOrder::LSB_FIRST,
+                descending ? Sorter::Direction::DESCENDING
+                           : Sorter::Direction::ASCENDING);
+}
+
+/*!
+ * @brief Label of a check: the keys and the sorter's configuration
+ */
+string configuration(const string &name, const bool msd,
+                     const bool descending) {
+  return " (" + name + (msd ? ", MSD" : ", LSD") +
+         (descending ? ", descending)" : ", ascending)");
+}
+
+/*!
+ * @brief Run a check for a signed, an unsigned and a floating-point key
+ *
+ * @param check Callable taking a key of the type and the type's name
+ */
+template <typename Check> void for_key_types(const Check &check) {
+  check(int32_t(), string("int32_t"));
+  check(uint64_t(), string("uint64_t"));
+  check(double(), string("double"));
+}
+
+/*!
+ * @brief Whether a call throws a RadixException with an error code
+ */
+template <typename Sorter>
+bool rejects(const function<void()> &call,
+             const typename Sorter::ErrorCode code) {
+  try {
+    call();
+    return false;
+  } catch (const typename Sorter::RadixException &e) {
+    return e.code() == code;
+  }
+}
+
+/*!
+ * @brief Whether constructing a sorter with a data type throws
+ *        UNSUPPORTED_DATA_TYPE
+ */
+template <typename T>
+bool rejects_data_type(const typename UniversalRadixSort<T>::DataType type) {
+  using Sorter = UniversalRadixSort<T>;
+  return rejects<Sorter>([type] { Sorter sorter(type); },
+                         Sorter::ErrorCode::UNSUPPORTED_DATA_TYPE);
+}
+
+/*!
+ * @brief Memory resource counting the allocations it serves, optionally
+ *        running out of memory after a number of them
+ */
+class CountingResource : public pmr::memory_resource {
+public:
+  explicit CountingResource(size_t granted = SIZE_MAX) : left_(granted) {}
+
+  size_t allocations = 0; ///< Allocations served
+  size_t largest = 0;     ///< Bytes of the largest allocation served
+  size_t refused = 0;     ///< Allocations that threw std::bad_alloc
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    if (left_ == 0) {
+      ++refused;
+      throw bad_alloc();
+    }
+    --left_;
+    ++allocations;
+    largest = max(largest, bytes);
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+  size_t left_; ///< Allocations still granted
+};
+
+/*!
+ * @brief Whether repeating a round of calls on a sorter allocates nothing
+ *        upstream of its workspace once warmed up
+ *
+ * The first round records the peak scratch use and the second grows the
+ * workspace to it; three more rounds must then be served from it.
+ */
+template <typename Sorter>
+bool reuses_workspace(Sorter &sorter, const function<void()> &round) {
+  CountingResource upstream;
+  SortWorkspace workspace(&upstream);
+  sorter.set_workspace(workspace);
+  round();
+  round();
+  const size_t warm = upstream.allocations;
+  for (int i = 0; i < 3; ++i) {
+    round();
+  }
+  sorter.set_workspace(nullptr);
+  return upstream.allocations == warm;
+}
+
 /*!
  * @brief Helper function to find maximum string length in an array
  */
@@ -329,6 +676,1194 @@ void test_edge_cases() {
       cout << "NULL pointer test: FAILED (unexpected error code)" << endl;
     }
   }
+
+  // Test case 3: data types that do not match the key type
+  report("Signed key as unsigned",
+         rejects_data_type<int32_t>(
+             UniversalRadixSort<int32_t>::DataType::UNSIGNED_OR_STRING));
+  report("Unsigned key as signed",
+         rejects_data_type<uint32_t>(
+             UniversalRadixSort<uint32_t>::DataType::SIGNED_INTEGER));
+  report("Float key as integer",
+         rejects_data_type<float>(
+             UniversalRadixSort<float>::DataType::SIGNED_INTEGER));
+  report("Double key as float",
+         rejects_data_type<double>(
+             UniversalRadixSort<double>::DataType::IEEE754_FLOAT));
+}
+
+/*!
+ * @brief Check a digit width against std::stable_sort in both processing
+ *        orders and directions
+ *
+ * Keys of every magnitude give every digit work to do, and a few
+ * distinct keys around zero leave most digits shared by all keys.
+ */
+template <typename T, unsigned Bits> void test_digit_width(const string &name) {
+  for (const bool msd : {false, true}) {
+    for (const bool descending : {false, true}) {
+      UniversalRadixSort<T, Bits> sorter =
+          make_sorter<T, Bits>(msd, descending);
+      bool passed = true;
+      for (const size_t n : {size_t(1), size_t(63), size_t(65), size_t(1000),
+                             size_t(70001)}) {
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(5)}) {
+          const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+          passed = passed &&
+                   sorts_to(sorter, keys, stable_order(keys, descending));
+        }
+      }
+      report("Digit width" + configuration(name, msd, descending), passed);
+    }
+  }
+}
+
+void test_digit_widths() {
+  cout << "\n--- TEST CASE 6: DIGIT WIDTHS ---" << endl;
+  test_digit_width<uint64_t, 16>("uint64_t, 16-bit digits");
+  test_digit_width<uint32_t, 8>("uint32_t, 8-bit digits");
+  test_digit_width<int32_t, 5>("int32_t, 5-bit digits");
+}
+
+/*!
+ * @brief Check write-combining scatter against std::stable_sort
+ *
+ * A handful of keys fills no line of its buckets, and larger sizes leave
+ * partial lines at most bucket edges. Sorting from one element past the
+ * start of a vector puts every line boundary elsewhere.
+ */
+template <typename T, unsigned Bits = default_radix_bits<T>::value>
+void test_write_combining(const string &name) {
+  for (const bool msd : {false, true}) {
+    for (const bool descending : {false, true}) {
+      using Sorter = UniversalRadixSort<T, Bits>;
+      Sorter sorter = make_sorter<T, Bits>(msd, descending);
+      sorter.set_scatter_mode(Sorter::ScatterMode::WRITE_COMBINING);
+      bool passed = true;
+      for (const size_t n : {size_t(5), size_t(100), size_t(4099),
+                             size_t(100003)}) {
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+          const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+          const vector<size_t> order = stable_order(keys, descending);
+          passed = passed && sorts_to(sorter, keys, order);
+
+          vector<T> shifted(n + 1);
+          vector<uint32_t> positions(n + 1);
+          for (size_t i = 0; i < n; ++i) {
+            shifted[i + 1] = keys[i];
+            positions[i + 1] = static_cast<uint32_t>(i);
+          }
+          sorter.sort(shifted.data() + 1, positions.data() + 1, n);
+          passed = passed &&
+                   same_bytes(vector<T>(shifted.begin() + 1, shifted.end()),
+                              permuted(keys, order)) &&
+                   equal(order.begin(), order.end(), positions.begin() + 1);
+        }
+      }
+      report("Write-combining scatter" + configuration(name, msd, descending),
+             passed);
+    }
+  }
+}
+
+void test_write_combining() {
+  cout << "\n--- TEST CASE 7: WRITE-COMBINING SCATTER ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_write_combining<decltype(key)>(name);
+  });
+
+  // 65536 buckets of staging lines would not stay in L2, so 16-bit digits
+  // scatter directly even when write-combining is asked for
+  report("Direct scatter of 16-bit digits",
+         !UniversalRadixSort<uint64_t, 16>::can_write_combine() &&
+             UniversalRadixSort<uint64_t, 8>::can_write_combine() &&
+             UniversalRadixSort<uint64_t>::can_write_combine());
+  test_write_combining<uint64_t, 16>("uint64_t, 16-bit digits");
+}
+
+/*!
+ * @brief Check MSB-first sorts against std::stable_sort
+ *
+ * Sizes around 64 end the recursion in insertion sort at once or one
+ * level down. Two distinct keys share every digit but the lowest, keys
+ * within 2^20 share the top digits, and keys of every magnitude recurse
+ * into buckets of all sizes.
+ */
+template <typename T> void test_msd_sort(const string &name) {
+  for (const bool descending : {false, true}) {
+    UniversalRadixSort<T> sorter = make_sorter<T>(true, descending);
+    bool passed = true;
+    for (const size_t n : {size_t(2), size_t(63), size_t(64), size_t(65),
+                           size_t(1000), size_t(100003)}) {
+      for (const uint64_t distinct :
+           {uint64_t(0), uint64_t(2), uint64_t(1) << 20}) {
+        const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        passed =
+            passed && sorts_to(sorter, keys, stable_order(keys, descending));
+      }
+    }
+    report("MSB-first sort" + configuration(name, true, descending), passed);
+  }
+}
+
+void test_msd_sort() {
+  cout << "\n--- TEST CASE 8: MSB-FIRST SORT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_msd_sort<decltype(key)>(name);
+  });
+}
+
+/*!
+ * @brief Check unstable sorts against the keys of std::stable_sort
+ *
+ * Unstable sorts permute in place from the most significant digit
+ * whatever the processing order.
+ */
+template <typename T> void test_unstable_sort(const string &name) {
+  for (const bool msd : {false, true}) {
+    for (const bool descending : {false, true}) {
+      using Sorter = UniversalRadixSort<T>;
+      Sorter sorter = make_sorter<T>(msd, descending);
+      sorter.set_stability(Sorter::Stability::UNSTABLE);
+      bool passed = true;
+      for (const size_t n : {size_t(1), size_t(64), size_t(65), size_t(5000),
+                             size_t(100003)}) {
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+          const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+          passed = passed && sorts_to(sorter, keys,
+                                      stable_order(keys, descending), false);
+        }
+      }
+      report("Unstable sort" + configuration(name, msd, descending), passed);
+    }
+  }
+}
+
+void test_unstable_sort() {
+  cout << "\n--- TEST CASE 9: UNSTABLE SORT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_unstable_sort<decltype(key)>(name);
+  });
+}
+
+/*!
+ * @brief Check descending sorts of keys mixed with the extremes of their
+ *        type against std::stable_sort
+ */
+template <typename T> void test_descending(const string &name) {
+  using limits = numeric_limits<T>;
+  vector<T> extremes = {limits::lowest(), limits::max(), limits::min(), T(0),
+                        T(1)};
+  if constexpr (limits::has_infinity) {
+    extremes.push_back(limits::infinity());
+    extremes.push_back(-limits::infinity());
+    extremes.push_back(limits::denorm_min());
+  }
+  for (const bool msd : {false, true}) {
+    UniversalRadixSort<T> sorter = make_sorter<T>(msd, true);
+    bool passed = true;
+    for (const size_t n : {size_t(10), size_t(1000), size_t(100003)}) {
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+        vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        for (size_t i = 0; i < n; i += 7) {
+          keys[i] = extremes[i / 7 % extremes.size()];
+        }
+        passed = passed && sorts_to(sorter, keys, stable_order(keys, true));
+      }
+    }
+    report("Descending sort with extremes" + configuration(name, msd, true),
+           passed);
+  }
+}
+
+void test_descending() {
+  cout << "\n--- TEST CASE 10: DESCENDING ORDER ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_descending<decltype(key)>(name);
+  });
+
+  // Equal strings must keep their input order rather than come out
+  // reversed
+  UniversalRadixSort<FixedString> sorter = make_sorter<FixedString>(true, true);
+  bool passed = true;
+  for (const unsigned letters : {2U, 26U}) {
+    const vector<FixedString> strings = random_strings(5000, letters, letters);
+    passed = passed && sorts_to(sorter, strings, stable_order(strings, true));
+  }
+  report("Descending string sort keeps ties in order", passed);
+}
+
+/*!
+ * @brief Check key-value sorts against std::stable_sort
+ */
+template <typename T> void test_key_value(const string &name) {
+  for (const bool msd : {false, true}) {
+    for (const bool descending : {false, true}) {
+      UniversalRadixSort<T> sorter = make_sorter<T>(msd, descending);
+      bool passed = true;
+      for (const size_t n : {size_t(1), size_t(64), size_t(65), size_t(1000),
+                             size_t(100003)}) {
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+          const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+          passed = passed &&
+                   sorts_to(sorter, keys, stable_order(keys, descending));
+        }
+      }
+      report("Key-value sort" + configuration(name, msd, descending), passed);
+    }
+  }
+
+  // A payload that must be moved, not copied bytewise
+  UniversalRadixSort<T> sorter;
+  const vector<T> keys = random_keys<T>(3000, 7, 12);
+  const vector<size_t> order = stable_order(keys, false);
+  vector<T> sorted = keys;
+  vector<string> labels(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    labels[i] = "value " + to_string(i);
+  }
+  sorter.sort(sorted, labels);
+  bool passed = same_bytes(sorted, permuted(keys, order));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    passed = passed && labels[i] == "value " + to_string(order[i]);
+  }
+  report("Key-value sort with string payload (" + name + ")", passed);
+}
+
+void test_key_value() {
+  cout << "\n--- TEST CASE 11: KEY-VALUE SORT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_key_value<decltype(key)>(name);
+  });
+
+  UniversalRadixSort<FixedString> sorter =
+      make_sorter<FixedString>(true, false);
+  const vector<FixedString> strings = random_strings(5000, 3, 11);
+  report("Key-value string sort",
+         sorts_to(sorter, strings, stable_order(strings, false)));
+
+  using Sorter = UniversalRadixSort<int32_t>;
+  Sorter ints;
+  vector<int32_t> keys = {3, 1, 2};
+  vector<uint32_t> values = {0, 1};
+  report("Key-value length mismatch",
+         rejects<Sorter>([&] { ints.sort(keys, values); },
+                         Sorter::ErrorCode::INVALID_ELEMENT_SIZE));
+  report("Key-value null payload",
+         rejects<Sorter>(
+             [&] {
+               ints.sort(keys.data(), static_cast<uint32_t *>(nullptr), 3);
+             },
+             Sorter::ErrorCode::NULL_POINTER));
+}
+
+void test_argsort() {
+  cout << "\n--- TEST CASE 12: ARGSORT ---" << endl;
+  // sorts_to() checks argsort next to the sorts, unstable ones included
+  for_key_types([](auto key, const string &name) {
+    using T = decltype(key);
+    using Sorter = UniversalRadixSort<T>;
+    for (const size_t n : {size_t(1), size_t(2), size_t(1000),
+                           size_t(100003)}) {
+      bool passed = true;
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(5)}) {
+        const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        for (const bool msd : {false, true}) {
+          for (const bool descending : {false, true}) {
+            const vector<size_t> order = stable_order(keys, descending);
+            Sorter sorter = make_sorter<T>(msd, descending);
+            passed = passed && sorts_to(sorter, keys, order);
+            sorter.set_stability(Sorter::Stability::UNSTABLE);
+            passed = passed && sorts_to(sorter, keys, order, false);
+          }
+        }
+      }
+      report("Argsort (" + name + ", n = " + to_string(n) + ")", passed);
+    }
+  });
+
+  UniversalRadixSort<FixedString> sorter =
+      make_sorter<FixedString>(true, false);
+  const vector<FixedString> strings = random_strings(5000, 3, 13);
+  report("Argsort (strings)",
+         sorts_to(sorter, strings, stable_order(strings, false)));
+
+  // The count is checked before the keys are read
+  if (sizeof(size_t) > sizeof(uint32_t)) {
+    using Sorter = UniversalRadixSort<int32_t>;
+    Sorter ints;
+    const int32_t key = 0;
+    uint32_t index = 0;
+    report("Argsort beyond 32-bit indices",
+           rejects<Sorter>(
+               [&] { ints.argsort(&key, size_t(UINT32_MAX) + 1, &index); },
+               Sorter::ErrorCode::INVALID_ARGUMENT));
+  }
+}
+
+/*!
+ * @brief Check parallel sorts against std::stable_sort for several thread
+ *        counts
+ *
+ * Keys within 2^20 share their top digits, so the MSB-first sort splits
+ * one hot bucket over the workers.
+ */
+template <typename T> void test_parallel(const string &name) {
+  using Sorter = UniversalRadixSort<T>;
+  // Around one and two blocks of MIN_PARALLEL_CHUNK (16384) per thread,
+  // and enough for every thread count below
+  for (const size_t n : {size_t(16383), size_t(32767), size_t(32768),
+                         size_t(32769), size_t(65537), size_t(200003)}) {
+    for (const bool msd : {false, true}) {
+      bool stable = true;
+      bool unstable = true;
+      for (const uint64_t distinct :
+           {uint64_t(0), uint64_t(1) << 20, uint64_t(3)}) {
+        const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        for (const bool descending : {false, true}) {
+          const vector<size_t> order = stable_order(keys, descending);
+          Sorter sorter = make_sorter<T>(msd, descending);
+          sorter.set_execution(Sorter::Execution::PARALLEL);
+          for (const size_t threads : {2, 3, 4, 7}) {
+            sorter.set_thread_count(threads);
+            sorter.set_stability(Sorter::Stability::STABLE);
+            stable = stable && sorts_to(sorter, keys, order);
+            sorter.set_stability(Sorter::Stability::UNSTABLE);
+            unstable = unstable && sorts_to(sorter, keys, order, false);
+          }
+        }
+      }
+      const string suffix = " (" + name + ", n = " + to_string(n) +
+                            (msd ? ", MSD)" : ", LSD)");
+      report("Parallel stable sort" + suffix, stable);
+      report("Parallel unstable sort" + suffix, unstable);
+    }
+  }
+}
+
+void test_parallel() {
+  cout << "\n--- TEST CASE 13: PARALLEL SORT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_parallel<decltype(key)>(name);
+  });
+
+  // Strings, on a pool shared with the sorter. Its workers are pinned to
+  // CPU 0 and to CPUs no cpu_set_t can hold, which leave them unpinned
+  auto pool = make_shared<ThreadPool>(4, vector<int>{0, -1, 1 << 20});
+  UniversalRadixSort<FixedString> strings_sorter =
+      make_sorter<FixedString>(true, false);
+  strings_sorter.set_execution(
+      UniversalRadixSort<FixedString>::Execution::PARALLEL);
+  strings_sorter.set_thread_pool(pool);
+  const vector<FixedString> strings = random_strings(70000, 3, 16);
+  report("Parallel string sort on a shared pool",
+         pool->size() == 4 && pool->pinned() <= 1 &&
+             sorts_to(strings_sorter, strings, stable_order(strings, false)));
+
+  // Two sorters borrowing one pool from two threads take turns on it
+  using Sorter = UniversalRadixSort<uint64_t>;
+  ThreadPool borrowed(3);
+  const vector<uint64_t> keys = random_keys<uint64_t>(100000, 0, 16);
+  const vector<size_t> order = stable_order(keys, false);
+  bool passed[2] = {false, false};
+  vector<thread> callers;
+  for (int i = 0; i < 2; ++i) {
+    callers.emplace_back([&, i] {
+      Sorter sorter = make_sorter<uint64_t>(i == 1, false);
+      sorter.set_execution(Sorter::Execution::PARALLEL);
+      sorter.set_thread_pool(borrowed);
+      passed[i] = sorts_to(sorter, keys, order);
+    });
+  }
+  for (thread &caller : callers) {
+    caller.join();
+  }
+  report("Concurrent sorts on a borrowed pool", passed[0] && passed[1]);
+}
+
+/*!
+ * @brief Check that a workspace serves every kind of sort once warmed up
+ *
+ * Each round sorts a large and a small array, with and without a payload
+ * and by argsort, stable and unstable, directly and write-combined.
+ */
+template <typename T> void test_workspace(const string &name) {
+  using Sorter = UniversalRadixSort<T>;
+  const vector<T> large = random_keys<T>(50000, 0, 17);
+  const vector<T> small = random_keys<T>(1000, 3, 17);
+  const vector<size_t> large_order = stable_order(large, false);
+  const vector<size_t> small_order = stable_order(small, false);
+  for (const bool msd : {false, true}) {
+    Sorter sorter = make_sorter<T>(msd, false);
+    bool sorted = true;
+    const bool reused = reuses_workspace(sorter, [&] {
+      for (const auto mode :
+           {Sorter::ScatterMode::DIRECT,
+            Sorter::ScatterMode::WRITE_COMBINING}) {
+        sorter.set_scatter_mode(mode);
+        sorter.set_stability(Sorter::Stability::STABLE);
+        sorted = sorted && sorts_to(sorter, large, large_order) &&
+                 sorts_to(sorter, small, small_order);
+        sorter.set_stability(Sorter::Stability::UNSTABLE);
+        sorted = sorted && sorts_to(sorter, large, large_order, false) &&
+                 sorts_to(sorter, small, small_order, false);
+      }
+    });
+    report("Workspace reuse" + configuration(name, msd, false),
+           sorted && reused);
+  }
+
+  Sorter sorter;
+  sorter.set_execution(Sorter::Execution::PARALLEL);
+  sorter.set_thread_count(3);
+  bool sorted = true;
+  const bool reused = reuses_workspace(
+      sorter, [&] { sorted = sorted && sorts_to(sorter, large, large_order); });
+  report("Workspace reuse by parallel sorts (" + name + ")", sorted && reused);
+}
+
+void test_workspace() {
+  cout << "\n--- TEST CASE 14: SORT WORKSPACE ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_workspace<decltype(key)>(name);
+  });
+
+  UniversalRadixSort<FixedString> sorter =
+      make_sorter<FixedString>(true, false);
+  const vector<FixedString> strings = random_strings(20000, 3, 17);
+  const vector<size_t> order = stable_order(strings, false);
+  bool sorted = true;
+  const bool reused = reuses_workspace(
+      sorter, [&] { sorted = sorted && sorts_to(sorter, strings, order); });
+  report("Workspace reuse by string sorts", sorted && reused);
+}
+
+/*!
+ * @brief Pages of virtual memory the process maps, 0 where unknown
+ */
+size_t mapped_pages() {
+  size_t pages = 0;
+#ifdef __linux__
+  ifstream("/proc/self/statm") >> pages;
+#endif
+  return pages;
+}
+
+void test_huge_pages() {
+  cout << "\n--- TEST CASE 15: HUGE PAGES ---" << endl;
+  // 4 MB of keys need scratch buffers past the 2 MB threshold
+  using Sorter = UniversalRadixSort<uint64_t>;
+  const vector<uint64_t> keys = random_keys<uint64_t>(size_t(1) << 19, 0, 18);
+  const vector<size_t> order = stable_order(keys, false);
+  for (const auto pages :
+       {Sorter::HugePages::ENABLED, Sorter::HugePages::PREFAULTED}) {
+    for (const bool msd : {false, true}) {
+      Sorter sorter = make_sorter<uint64_t>(msd, false);
+      sorter.set_huge_pages(pages);
+      report(string("Huge page sort (") +
+                 (pages == Sorter::HugePages::ENABLED ? "enabled"
+                                                      : "prefaulted") +
+                 (msd ? ", MSD)" : ", LSD)"),
+             sorts_to(sorter, keys, order));
+    }
+  }
+
+  // A workspace on huge pages passes only small buffers upstream
+  CountingResource upstream;
+  {
+    HugePageResource huge_pages(true, HugePageResource::HUGE_PAGE_SIZE,
+                                &upstream);
+    SortWorkspace workspace(&huge_pages);
+    Sorter sorter;
+    sorter.set_workspace(workspace);
+    bool passed = true;
+    for (int i = 0; i < 3; ++i) {
+      passed = passed && sorts_to(sorter, keys, order);
+    }
+#ifdef __linux__
+    passed = passed && upstream.largest < HugePageResource::HUGE_PAGE_SIZE &&
+             workspace.capacity() >= keys.size() * sizeof(uint64_t);
+#endif
+    report("Huge page workspace", passed);
+  }
+
+  // Mapped buffers are 2 MB aligned and writable, and are unmapped in
+  // full: 50 leaked buffers would map at least 200 MB more
+  HugePageResource huge_pages;
+  const size_t before = mapped_pages();
+  bool aligned = true;
+  for (size_t i = 0; i < 50; ++i) {
+    const size_t bytes = (size_t(3) << 20) + i * 4096;
+    void *buffer = huge_pages.allocate(bytes, 64);
+    memset(buffer, 0xab, bytes);
+#ifdef __linux__
+    aligned = aligned && reinterpret_cast<uintptr_t>(buffer) %
+                                 HugePageResource::HUGE_PAGE_SIZE ==
+                             0;
+#endif
+    huge_pages.deallocate(buffer, bytes, 64);
+  }
+  report("Huge page buffers",
+         aligned && mapped_pages() <= before + (size_t(4) << 20) / 4096);
+}
+
+/*!
+ * @brief Check budgeted stable sorts against std::stable_sort
+ */
+template <typename Sorter, typename T>
+void test_budget(Sorter sorter, const string &name, const vector<T> &keys,
+                 const bool descending) {
+  const vector<size_t> order = stable_order(keys, descending);
+  const size_t element_bytes = sizeof(T) + sizeof(uint32_t);
+  bool passed = sorts_to(sorter, keys, order);
+  // Smaller than a run of the smallest size, a few runs, half the input
+  for (const size_t budget :
+       {size_t(1), 64 * element_bytes - 1, 300 * element_bytes,
+        keys.size() / 2 * element_bytes}) {
+    sorter.set_memory_budget(budget);
+    passed = passed && sorts_to(sorter, keys, order);
+  }
+  report("Memory budget (" + name + ")", passed);
+}
+
+/*!
+ * @brief Check sorts on a workspace that cannot grow past half their peak
+ *        scratch use, so they must fall back to sorting smaller runs
+ */
+template <typename Sorter, typename T>
+void test_out_of_memory(Sorter sorter, const string &name,
+                        const vector<T> &keys, const bool descending) {
+  const vector<size_t> order = stable_order(keys, descending);
+  // A first round records the peak and a second grows a workspace to it
+  SortWorkspace sized;
+  sorter.set_workspace(sized);
+  bool passed = sorts_to(sorter, keys, order) && sorts_to(sorter, keys, order);
+
+  CountingResource upstream(1);
+  SortWorkspace workspace(&upstream);
+  workspace.reserve(sized.capacity() / 2);
+  sorter.set_workspace(workspace);
+  passed = passed && sorts_to(sorter, keys, order);
+  sorter.set_workspace(nullptr);
+  report("Out of scratch memory (" + name + ")",
+         passed && upstream.refused > 0);
+}
+
+void test_memory_budget() {
+  cout << "\n--- TEST CASE 16: MEMORY BUDGET ---" << endl;
+  for (const bool msd : {false, true}) {
+    const string suffix = msd ? ", MSD" : ", LSD";
+    test_budget(make_sorter<int32_t>(msd, false), "int32_t" + suffix,
+                random_keys<int32_t>(1500, 100, 19), false);
+    test_budget(make_sorter<double>(msd, true), "double descending" + suffix,
+                random_keys<double>(1000, 2000, 19), true);
+  }
+  test_budget(make_sorter<FixedString>(true, false), "strings",
+              random_strings(1000, 4, 19), false);
+
+  // Scratch memory running out on large sorts
+  for (const bool msd : {false, true}) {
+    const string suffix = msd ? ", MSD" : ", LSD";
+    test_out_of_memory(make_sorter<int32_t>(msd, false), "int32_t" + suffix,
+                       random_keys<int32_t>(100000, 0, 19), false);
+    test_out_of_memory(make_sorter<double>(msd, true),
+                       "double descending" + suffix,
+                       random_keys<double>(100000, 0, 19), true);
+  }
+
+  // Sorts too small to split report that memory ran out
+  using Sorter = UniversalRadixSort<int32_t>;
+  Sorter sorter;
+  CountingResource upstream(0);
+  SortWorkspace workspace(&upstream);
+  sorter.set_workspace(workspace);
+  vector<int32_t> keys = random_keys<int32_t>(50, 0, 19);
+  report("Scratch memory exhausted",
+         rejects<Sorter>([&] { sorter.sort(keys); },
+                         Sorter::ErrorCode::MEMORY_ALLOCATION));
+}
+
+/*!
+ * @brief Records of 20 bytes: a sequence number, a key at offset 8 and a
+ *        checksum of both
+ */
+template <typename T>
+vector<unsigned char> external_records(size_t n, uint64_t distinct) {
+  constexpr size_t record_size = 20;
+  const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+  vector<unsigned char> records(n * record_size, 0);
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char *record = &records[i * record_size];
+    const uint32_t sequence = static_cast<uint32_t>(i);
+    const uint32_t check = sequence * 2654435761U;
+    memcpy(record, &sequence, sizeof(sequence));
+    memcpy(record + 8, &keys[i], sizeof(T));
+    memcpy(record + 16, &check, sizeof(check));
+  }
+  return records;
+}
+
+/*!
+ * @brief Whether an external sort of records writes them like
+ *        std::stable_sort by key, and how many merge passes it took
+ *
+ * @param in_place Sort the file into itself
+ * @param passes Merge passes reported by the sort, on return
+ */
+template <typename T>
+bool external_sorts_to(ExternalRadixSort<T> &external,
+                       const vector<unsigned char> &records,
+                       const bool descending,
+                       const filesystem::path &directory, const bool in_place,
+                       size_t &passes) {
+  constexpr size_t record_size = 20;
+  const size_t n = records.size() / record_size;
+  const filesystem::path input = directory / "input.bin";
+  const filesystem::path output = in_place ? input : directory / "output.bin";
+  ofstream(input, ios::binary)
+      .write(reinterpret_cast<const char *>(records.data()),
+             static_cast<streamsize>(records.size()));
+
+  passes = 0;
+  external.set_temp_directory((directory / "runs").string());
+  external.set_progress([&](const typename ExternalRadixSort<T>::Progress &p) {
+    passes = max(passes, p.pass);
+  });
+  external.sort_file(input.string(), output.string());
+
+  vector<T> keys(n);
+  for (size_t i = 0; i < n; ++i) {
+    memcpy(&keys[i], &records[i * record_size + 8], sizeof(T));
+  }
+  const vector<size_t> order = stable_order(keys, descending);
+  vector<unsigned char> expected(records.size());
+  for (size_t i = 0; i < n; ++i) {
+    memcpy(&expected[i * record_size], &records[order[i] * record_size],
+           record_size);
+  }
+
+  ifstream file(output, ios::binary);
+  vector<unsigned char> sorted(records.size() + 1);
+  file.read(reinterpret_cast<char *>(sorted.data()),
+            static_cast<streamsize>(sorted.size()));
+  sorted.resize(static_cast<size_t>(file.gcount()));
+  return sorted == expected && filesystem::is_empty(directory / "runs");
+}
+
+template <typename T> void test_external_sort(const string &name) {
+  using External = ExternalRadixSort<T>;
+  const filesystem::path directory =
+      filesystem::temp_directory_path() /
+      ("radix_external_test_" + name);
+  filesystem::remove_all(directory);
+  filesystem::create_directories(directory / "runs");
+
+  // Limits giving one run, a few runs merged at once (fan-in 3), and
+  // dozens of runs merged two at a time over several passes
+  struct Case {
+    const char *label;
+    size_t limit;
+    size_t n;
+    bool merged;
+    bool several_passes;
+  };
+  const Case cases[] = {{"one run", 0, 20000, false, false},
+                        {"single merge", size_t(1) << 20, 50000, true, false},
+                        {"several merge passes", 4096, 3000, true, true}};
+  for (const bool descending : {false, true}) {
+    for (const Case &c : cases) {
+      for (const bool in_place : {false, true}) {
+        External external(20, 8, make_sorter<T>(false, descending));
+        if (c.limit != 0) {
+          external.set_memory_limit(c.limit);
+        }
+        size_t passes = 0;
+        bool passed = true;
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(7)}) {
+          passed = passed &&
+                   external_sorts_to(external,
+                                     external_records<T>(c.n, distinct),
+                                     descending, directory, in_place,
+                                     passes) &&
+                   (passes > 0) == c.merged &&
+                   (passes > 1) == c.several_passes;
+        }
+        report(string("External sort, ") + c.label + " (" + name +
+                   (descending ? ", descending" : ", ascending") +
+                   (in_place ? ", in place)" : ")"),
+               passed);
+      }
+    }
+  }
+
+  // An empty file, and a limit below two records
+  External external(20, 8);
+  size_t passes = 0;
+  report("External sort of an empty file (" + name + ")",
+         external_sorts_to(external, {}, false, directory, false, passes));
+  external.set_memory_limit(10);
+  report("External sort with a tiny memory limit (" + name + ")",
+         rejects<External>(
+             [&] {
+               external_sorts_to(external, external_records<T>(2, 7), false,
+                                 directory, false, passes);
+             },
+             External::ErrorCode::MEMORY_ALLOCATION) &&
+             filesystem::is_empty(directory / "runs"));
+  report("External key outside the record (" + name + ")",
+         rejects<External>([] { External misplaced(20, 16); },
+                           External::ErrorCode::INVALID_ELEMENT_SIZE));
+  filesystem::remove_all(directory);
+}
+
+void test_external_sort() {
+  cout << "\n--- TEST CASE 17: EXTERNAL SORT ---" << endl;
+  // The merges order records by precedes(), which must agree with the
+  // radix order
+  for_key_types([](auto key, const string &name) {
+    using T = decltype(key);
+    bool passed = true;
+    for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+      const vector<T> keys = random_keys<T>(1000, distinct, 20);
+      for (const bool descending : {false, true}) {
+        const UniversalRadixSort<T> sorter = make_sorter<T>(false, descending);
+        for (size_t i = 1; i < keys.size(); ++i) {
+          passed = passed && sorter.precedes(keys[i - 1], keys[i]) ==
+                                 (descending ? key_less(keys[i], keys[i - 1])
+                                             : key_less(keys[i - 1], keys[i]));
+        }
+      }
+    }
+    report("Key comparison (" + name + ")", passed);
+  });
+
+  test_external_sort<int64_t>("int64_t");
+  test_external_sort<double>("double");
+}
+
+/*!
+ * @brief Whether a stream yields its pushed batches like std::stable_sort
+ *        of their concatenation, also after begin() restarts the merge
+ *
+ * Batches are pushed alternately by pointer and by vector.
+ *
+ * @param runs Expected number of runs, 0 to not check
+ */
+template <typename T>
+bool streams_to(StreamingRadixSorter<T> &stream,
+                const vector<vector<T>> &batches, const bool descending,
+                const size_t runs) {
+  vector<T> pushed;
+  for (size_t i = 0; i < batches.size(); ++i) {
+    if (i % 2 == 0) {
+      stream.push(batches[i].data(), batches[i].size());
+    } else {
+      stream.push(batches[i]);
+    }
+    pushed.insert(pushed.end(), batches[i].begin(), batches[i].end());
+  }
+  const vector<T> expected = permuted(pushed, stable_order(pushed, descending));
+  if (stream.size() != expected.size() ||
+      (runs != 0 && stream.run_count() != runs)) {
+    return false;
+  }
+
+  // Stop halfway once, then read everything after a restart
+  for (const size_t stop : {expected.size() / 2, expected.size()}) {
+    vector<T> merged;
+    for (auto it = stream.begin();
+         it != stream.end() && merged.size() < stop; ++it) {
+      merged.push_back(*it);
+    }
+    if (!same_bytes(merged, vector<T>(expected.begin(),
+                                      expected.begin() + stop))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+ * @brief Keys cut into batches of uneven sizes, empty ones included
+ */
+template <typename T>
+vector<vector<T>> stream_batches(const vector<T> &keys) {
+  vector<vector<T>> batches;
+  size_t begin = 0;
+  for (const size_t size : {37, 1, 0, 200, 5, 1000, 64, 3, 0, 2500, 17}) {
+    const size_t end = min(keys.size(), begin + size);
+    batches.emplace_back(keys.begin() + begin, keys.begin() + end);
+    begin = end;
+  }
+  return batches;
+}
+
+template <typename T> void test_streaming(const string &name) {
+  for (const bool descending : {false, true}) {
+    const UniversalRadixSort<T> sorter = make_sorter<T>(false, descending);
+    const string suffix =
+        " (" + name + (descending ? ", descending)" : ", ascending)");
+    for (const uint64_t distinct : {uint64_t(0), uint64_t(4)}) {
+      const vector<vector<T>> batches =
+          stream_batches(random_keys<T>(3827, distinct, distinct));
+      // Runs of 256 keys take the small batches in on push; a run of no
+      // bytes leaves one run per non-empty batch
+      StreamingRadixSorter<T> merging(sorter, 256 * sizeof(T));
+      report("Stream merging on push" + suffix,
+             streams_to(merging, batches, descending, 0) &&
+                 merging.run_count() < 9);
+      StreamingRadixSorter<T> separate(sorter, 0);
+      report("Stream of separate runs" + suffix,
+             streams_to(separate, batches, descending, 9));
+
+      separate.clear();
+      const bool cleared = separate.size() == 0 &&
+                           separate.run_count() == 0 &&
+                           separate.begin() == separate.end();
+      report("Stream after clear" + suffix,
+             cleared &&
+                 streams_to(separate,
+                            stream_batches(random_keys<T>(
+                                3827, distinct, distinct + 1)),
+                            descending, 9));
+    }
+  }
+}
+
+void test_streaming() {
+  cout << "\n--- TEST CASE 18: STREAMING ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_streaming<decltype(key)>(name);
+  });
+
+  // Equal strings must come out in push order, whether merged on push or
+  // across runs
+  const UniversalRadixSort<FixedString> sorter =
+      make_sorter<FixedString>(true, false);
+  const vector<vector<FixedString>> batches =
+      stream_batches(random_strings(3827, 3, 22));
+  StreamingRadixSorter<FixedString> merging(sorter, 512 * sizeof(FixedString));
+  report("Stream keeps push order on ties (merging on push)",
+         streams_to(merging, batches, false, 0));
+  StreamingRadixSorter<FixedString> separate(sorter, 0);
+  report("Stream keeps push order on ties (separate runs)",
+         streams_to(separate, batches, false, 9));
+}
+
+/*!
+ * @brief Whether partial_sort puts the first k elements of an expected
+ *        order in front, alone and with a payload, and keeps the others
+ *
+ * @param order Positions of the keys in the expected order
+ * @param k Number of leading elements to sort, above n for all
+ */
+template <typename Sorter, typename T>
+bool partially_sorts_to(Sorter &sorter, const vector<T> &keys,
+                        const vector<size_t> &order, const size_t k) {
+  const size_t head = min(k, keys.size());
+  vector<T> sorted = keys;
+  sorter.partial_sort(sorted, k);
+  if (!same_bytes(vector<T>(sorted.begin(), sorted.begin() + head),
+                  permuted(keys, vector<size_t>(order.begin(),
+                                                order.begin() + head)))) {
+    return false;
+  }
+
+  // The payload is the position of each key: every key stays with it,
+  // and each position appears once
+  sorted = keys;
+  vector<uint32_t> positions(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    positions[i] = static_cast<uint32_t>(i);
+  }
+  sorter.partial_sort(sorted, positions, k);
+  vector<bool> seen(keys.size(), false);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (positions[i] >= keys.size() || seen[positions[i]] ||
+        memcmp(&sorted[i], &keys[positions[i]], sizeof(T)) != 0 ||
+        (i < head && positions[i] != order[i])) {
+      return false;
+    }
+    seen[positions[i]] = true;
+  }
+  return true;
+}
+
+/*!
+ * @brief Check partial sorts against std::stable_sort
+ *
+ * k up to n / 512 is selected with a heap and larger k by narrowing the
+ * k-th key digit by digit, so k runs on both sides of that switch.
+ */
+template <typename T> void test_partial_sort(const string &name) {
+  for (const size_t n : {size_t(1000), size_t(100003)}) {
+    const size_t heap = n / 512;
+    for (const bool descending : {false, true}) {
+      UniversalRadixSort<T> sorter = make_sorter<T>(false, descending);
+      bool passed = true;
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+        const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        const vector<size_t> order = stable_order(keys, descending);
+        for (const size_t k : {size_t(0), size_t(1), heap, heap + 1, n / 3,
+                               n - 1, n, n + 7}) {
+          passed = passed && partially_sorts_to(sorter, keys, order, k);
+        }
+      }
+      report("Partial sort (" + name + ", n = " + to_string(n) +
+                 (descending ? ", descending)" : ", ascending)"),
+             passed);
+    }
+  }
+
+  UniversalRadixSort<T> sorter;
+  const vector<T> keys = random_keys<T>(100003, 0, 23);
+  bool sorted = true;
+  const bool reused = reuses_workspace(sorter, [&] {
+    for (const size_t k : {size_t(10), size_t(5000)}) {
+      vector<T> copy = keys;
+      sorter.partial_sort(copy, k);
+      sorted = sorted && is_sorted(copy.begin(), copy.begin() + k,
+                                   [](const T &a, const T &b) {
+                                     return key_less(a, b);
+                                   });
+    }
+  });
+  report("Partial sort workspace reuse (" + name + ")", sorted && reused);
+}
+
+void test_partial_sort() {
+  cout << "\n--- TEST CASE 19: PARTIAL SORT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_partial_sort<decltype(key)>(name);
+  });
+
+  // String keys sort the whole array
+  UniversalRadixSort<FixedString> sorter =
+      make_sorter<FixedString>(true, false);
+  const vector<FixedString> strings = random_strings(3000, 3, 23);
+  const vector<size_t> order = stable_order(strings, false);
+  bool passed = true;
+  for (const size_t k : {size_t(0), size_t(5), size_t(3000)}) {
+    passed = passed && partially_sorts_to(sorter, strings, order, k);
+  }
+  report("Partial sort (strings)", passed);
+}
+
+/*!
+ * @brief Whether nth_element and quantiles find the same elements as a
+ *        stably sorted copy, leaving the keys as they were
+ *
+ * @param ranks Ranks to find, repeated and in any order
+ * @param fractions Quantiles to find, of rank ceil(q * n) - 1 or 0
+ */
+template <typename T>
+bool selects_like_sort(UniversalRadixSort<T> &sorter, const vector<T> &keys,
+                       const bool descending, const vector<size_t> &ranks,
+                       const vector<double> &fractions) {
+  const vector<T> sorted = permuted(keys, stable_order(keys, descending));
+  auto same = [](const T &a, const T &b) {
+    return memcmp(&a, &b, sizeof(T)) == 0;
+  };
+
+  const vector<T> original = keys;
+  for (const size_t rank : ranks) {
+    if (!same(sorter.nth_element(keys, rank), sorted[rank])) {
+      return false;
+    }
+  }
+  const vector<T> found = sorter.quantiles(keys, fractions);
+  for (size_t i = 0; i < fractions.size(); ++i) {
+    const double rank = ceil(fractions[i] * static_cast<double>(keys.size()));
+    if (!same(found[i], sorted[rank < 1.0 ? 0 : size_t(rank) - 1])) {
+      return false;
+    }
+  }
+  return same_bytes(keys, original);
+}
+
+template <typename T> void test_selection(const string &name) {
+  using Sorter = UniversalRadixSort<T>;
+  // 11 distinct ranks narrow digit by digit once n reaches 11 histograms
+  // of 2048 buckets, and sort a copy below that
+  for (const size_t n : {size_t(1), size_t(1000), size_t(22527),
+                         size_t(22528), size_t(200003)}) {
+    vector<size_t> ranks = {0, n - 1, n / 2, n / 2, 0};
+    for (size_t i = 1; i <= 9; ++i) {
+      ranks.push_back(n * i / 10);
+    }
+    ranks.push_back(n - 1);
+    const vector<double> fractions = {0.0, 1.0, 0.5, 0.001, 0.25, 0.5,
+                                      0.999, 0.0, 1.0, 0.1, 0.2, 0.3, 0.4};
+    for (const bool descending : {false, true}) {
+      Sorter sorter = make_sorter<T>(false, descending);
+      const string suffix =
+          " (" + name + ", n = " + to_string(n) +
+          (descending ? ", descending)" : ", ascending)");
+      // Keys of every magnitude put every rank in its own group, heavy
+      // duplicates put them all in a few
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(3)}) {
+        const vector<T> keys = random_keys<T>(n, distinct, n + distinct);
+        report((distinct == 3 ? "Selection with duplicates" : "Selection") +
+                   suffix,
+               selects_like_sort(sorter, keys, descending, ranks, fractions));
+      }
+    }
+  }
+
+  // Both the narrowing and the sorted copy borrow from the workspace
+  Sorter sorter;
+  const vector<T> large = random_keys<T>(200003, 0, 24);
+  const vector<T> small = random_keys<T>(1000, 0, 24);
+  bool selected = true;
+  const bool reused = reuses_workspace(sorter, [&] {
+    for (const vector<T> *keys : {&large, &small}) {
+      selected = selected && selects_like_sort(sorter, *keys, false,
+                                               {keys->size() / 3},
+                                               {0.1, 0.5, 0.9});
+    }
+  });
+  report("Selection workspace reuse (" + name + ")", selected && reused);
+
+  const vector<T> keys(10, T(1));
+  auto rejects_argument = [](const function<void()> &call) {
+    return rejects<Sorter>(call, Sorter::ErrorCode::INVALID_ARGUMENT);
+  };
+  report("Rank out of range (" + name + ")", rejects_argument([&] {
+           sorter.nth_element(keys, keys.size());
+         }));
+  report("Quantile out of range (" + name + ")", rejects_argument([&] {
+           sorter.quantiles(keys, {0.5, 1.5});
+         }));
+  report("Negative quantile (" + name + ")", rejects_argument([&] {
+           sorter.quantiles(keys, {-0.25});
+         }));
+  report("NaN quantile (" + name + ")", rejects_argument([&] {
+           sorter.quantiles(keys, {nan("")});
+         }));
+  report("Quantile of empty array (" + name + ")", rejects_argument([&] {
+           sorter.quantiles(vector<T>(), {0.5});
+         }));
+}
+
+void test_selection() {
+  cout << "\n--- TEST CASE 20: SELECTION AND QUANTILES ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_selection<decltype(key)>(name);
+  });
+}
+
+/*!
+ * @brief Keys cut into runs that are each sorted in an order
+ *
+ * @param n Number of keys
+ * @param runs Number of sorted runs, 1 for fully sorted input
+ * @param descending Sort every run from largest to smallest
+ * @param distinct Number of distinct keys, small for many ties
+ */
+template <typename T>
+vector<T> presorted_keys(const size_t n, const size_t runs,
+                         const bool descending, const uint64_t distinct) {
+  vector<T> keys = random_keys<T>(n, distinct, n * 31 + runs);
+  const size_t length = (n + runs - 1) / runs;
+  for (size_t begin = 0; begin < n; begin += length) {
+    stable_sort(keys.begin() + begin, keys.begin() + min(n, begin + length),
+                [&](const T &a, const T &b) {
+                  return descending ? key_less(b, a) : key_less(a, b);
+                });
+  }
+  return keys;
+}
+
+template <typename T> void test_presorted(const string &name) {
+  using Sorter = UniversalRadixSort<T>;
+  // MAX_NATURAL_RUNS of 4- and 8-byte keys with the default digit width
+  const size_t max_runs = sizeof(T) == 8 ? 8 : 4;
+  // Sizes on both sides of a scan block and not a multiple of a vector
+  for (const size_t n : {size_t(7), size_t(1023), size_t(1025),
+                         size_t(10007)}) {
+    for (const bool descending : {false, true}) {
+      Sorter sorter = make_sorter<T>(false, descending);
+      const string suffix =
+          " (" + name + ", n = " + to_string(n) +
+          (descending ? ", descending)" : ", ascending)");
+      bool passed = true;
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(5)}) {
+        const vector<T> keys = presorted_keys<T>(n, 1, descending, distinct);
+        passed =
+            passed && sorts_to(sorter, keys, stable_order(keys, descending));
+      }
+      report("Already sorted" + suffix, passed);
+
+      // Ties of reversed input must get back their input order
+      passed = true;
+      for (const uint64_t distinct : {uint64_t(0), uint64_t(5)}) {
+        const vector<T> keys = presorted_keys<T>(n, 1, !descending, distinct);
+        const vector<size_t> order = stable_order(keys, descending);
+        passed = passed && sorts_to(sorter, keys, order);
+        sorter.set_stability(Sorter::Stability::UNSTABLE);
+        passed = passed && sorts_to(sorter, keys, order, false);
+        sorter.set_stability(Sorter::Stability::STABLE);
+      }
+      report("Reversed with ties" + suffix, passed);
+
+      // Runs are merged through a buffer of 64 elements at most, and one
+      // more run than merged falls through to the radix sort
+      passed = true;
+      sorter.set_memory_budget(64 * (sizeof(T) + sizeof(uint32_t)));
+      for (size_t runs = 2; runs <= max_runs + 1; ++runs) {
+        for (const uint64_t distinct : {uint64_t(0), uint64_t(5)}) {
+          const vector<T> keys =
+              presorted_keys<T>(n, runs, descending, distinct);
+          passed = passed &&
+                   sorts_to(sorter, keys, stable_order(keys, descending));
+        }
+      }
+      sorter.set_memory_budget(0);
+      report("Ascending runs" + suffix, passed);
+
+      // With only the byte it reserved, a workspace that cannot grow
+      // leaves the runs no merge buffer at all. Argsort is left out, as
+      // its copy of the keys would not fit either
+      passed = true;
+      bool refused = false;
+      for (size_t runs = 2; runs <= max_runs; ++runs) {
+        CountingResource upstream(1);
+        SortWorkspace workspace(&upstream);
+        workspace.reserve(1);
+        sorter.set_workspace(workspace);
+        const vector<T> keys = presorted_keys<T>(n, runs, descending, 100);
+        const vector<size_t> order = stable_order(keys, descending);
+        vector<T> sorted = keys;
+        sorter.sort(sorted);
+        passed = passed && same_bytes(sorted, permuted(keys, order));
+        sorted = keys;
+        vector<size_t> positions(n);
+        for (size_t i = 0; i < n; ++i) {
+          positions[i] = i;
+        }
+        sorter.sort(sorted, positions);
+        passed = passed && positions == order;
+        refused = refused || upstream.refused > 0;
+        sorter.set_workspace(nullptr);
+      }
+      report("Merging runs without a buffer" + suffix, passed && refused);
+    }
+  }
+
+  // A few sorted runs: parallel sorts skip the run merge
+  Sorter sorter;
+  sorter.set_execution(Sorter::Execution::PARALLEL);
+  sorter.set_thread_count(4);
+  const vector<T> keys = presorted_keys<T>(100000, 3, false, 7);
+  report("Parallel sort of presorted runs (" + name + ")",
+         sorts_to(sorter, keys, stable_order(keys, false)));
+}
+
+void test_presorted_input() {
+  cout << "\n--- TEST CASE 21: PRESORTED INPUT ---" << endl;
+  for_key_types([](auto key, const string &name) {
+    test_presorted<decltype(key)>(name);
+  });
 }
 
 // Performance measurement functions
@@ -406,14 +1941,13 @@ double measure_std_sort(vector<float> &data) {
   return measure_time([&]() { sort(data.begin(), data.end()); });
 }
 
-double measure_radix_sort_strings(vector<char> &buffer, size_t n,
-                                  size_t element_size) {
-  UniversalRadixSort<char> sorter(
-      UniversalRadixSort<char>::DataType::UNSIGNED_OR_STRING,
-      UniversalRadixSort<char>::ProcessingOrder::MSB_FIRST,
-      UniversalRadixSort<char>::Direction::ASCENDING);
+double measure_radix_sort_strings(vector<FixedString> &buffer) {
+  UniversalRadixSort<FixedString> sorter(
+      UniversalRadixSort<FixedString>::DataType::UNSIGNED_OR_STRING,
+      UniversalRadixSort<FixedString>::ProcessingOrder::MSB_FIRST,
+      UniversalRadixSort<FixedString>::Direction::ASCENDING);
 
-  return measure_time([&]() { sorter.sort(buffer.data(), n); });
+  return measure_time([&]() { sorter.sort(buffer); });
 }
 
 double measure_std_sort_strings(vector<string> &data) {
@@ -472,17 +2006,16 @@ void measure_performance() {
     vector<string> string_data;
     generate_random_strings(string_data, size, string_length);
 
-    size_t element_size = string_length + 1;
-    vector<char> buffer(string_data.size() * element_size);
+    const size_t element_size = sizeof(FixedString);
+    vector<FixedString> buffer(string_data.size());
 
     for (size_t i = 0; i < string_data.size(); i++) {
-      char *dest = &buffer[i * element_size];
-      strncpy(dest, string_data[i].c_str(), element_size);
+      char *dest = buffer[i].data;
+      strncpy(dest, string_data[i].c_str(), element_size - 1);
       dest[element_size - 1] = '\0';
     }
 
-    double radix_time =
-        measure_radix_sort_strings(buffer, string_data.size(), element_size);
+    double radix_time = measure_radix_sort_strings(buffer);
     double std_time = measure_std_sort_strings(string_data);
     double speedup = std_time / radix_time;
 
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Smoke test of the radixsort tool: builds it, sorts random files of bare
+# keys and of keyed records, and checks that every file comes out in key
+# order with the same records. Needs g++, od and a POSIX shell.
+#
+# Usage: ./test_radixsort.sh (from the repository root); exits with status
+# 1 if a check fails
+
+set -u
+export LC_ALL=C
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+tool="$dir/radixsort"
+g++ -std=c++17 -O2 -pthread radixsort.cpp -o "$tool" || exit 1
+
+failures=0
+
+report() {
+  if [ "$2" -eq 0 ]; then
+    echo "$1 test: PASSED"
+  else
+    echo "$1 test: FAILED"
+    failures=$((failures + 1))
+  fi
+}
+
+# sorts NAME RECORDS WIDTH OD_TYPE FIELD SORT_ORDER [TOOL_OPTION...]
+#
+# Sorts RECORDS random records of WIDTH bytes, printed by od as OD_TYPE
+# words of which FIELD is the key, and checks the keys with sort -C and
+# SORT_ORDER, and the records against the input as a multiset
+sorts() {
+  name=$1 records=$2 width=$3 type=$4 field=$5 order=$6
+  shift 6
+  head -c $((records * width)) /dev/urandom >"$dir/data"
+  od -An -v -w"$width" -t"$type" "$dir/data" | sort >"$dir/before"
+  "$tool" "$@" "$dir/data" &&
+    od -An -v -w"$width" -t"$type" "$dir/data" |
+    awk -v field="$field" '{ print $field }' | sort -C $order &&
+    od -An -v -w"$width" -t"$type" "$dir/data" | sort |
+    cmp -s - "$dir/before"
+  report "$name" $?
+}
+
+sorts "Bare u64 keys" 100000 8 u8 1 -n -t u64
+sorts "Bare i32 keys, reversed" 100003 4 d4 1 -nr -t i32 -r
+sorts "Bare u16 keys on 4 threads" 70000 2 u2 1 -n -t u16 -j 4
+sorts "u32 keys at offset 4 of 16-byte records" 50000 16 u4 2 -n \
+  -t u32 -o 4 -w 16
+sorts "i64 keys at offset 8 of 24-byte records, reversed, on 4 threads" \
+  80000 24 d8 2 -nr -t i64 -o 8 -w 24 -r -j 4
+sorts "Single record" 1 16 u4 2 -n -t u32 -o 4 -w 16
+
+# Errors exit with status 1, bad command lines with 2
+head -c 10 /dev/urandom >"$dir/data"
+"$tool" -t u64 "$dir/data" 2>/dev/null
+report "Partial record" $(($? != 1))
+"$tool" -t u32 -o 2 -w 4 "$dir/data" 2>/dev/null
+report "Key outside the record" $(($? != 1))
+"$tool" -t u128 "$dir/data" 2>/dev/null
+report "Unknown key type" $(($? != 1))
+"$tool" "$dir/missing" 2>/dev/null
+report "Missing file" $(($? != 1))
+"$tool" 2>/dev/null
+report "No file given" $(($? != 2))
+
+if [ "$failures" -gt 0 ]; then
+  echo "$failures check(s) FAILED"
+  exit 1
+fi
@@ -10,499 +10,4748 @@
 #define UNIVERSAL_RADIX_SORT_HPP
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UNIVERSAL_RADIX_SORT_HAS_SSE2 1
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 namespace radix {
 
+namespace detail {
+
 /*!
- * @brief Universal Radix Sort implementation with class-based design
+ * @brief Unsigned integer with the same width as a key, void if none exists
  *
- * This class template provides a flexible and type-safe implementation of
- * radix sort for various data types including signed integers, floating-point
- * numbers, and strings.
+ * Keys of 1, 2, 4 or 8 bytes are loaded as one integer so digits of any
+ * width can be extracted with a shift and a mask; other sizes are sorted
+ * byte by byte.
+ */
+template <size_t Size> struct unsigned_key {
+  using type = void;
+};
+template <> struct unsigned_key<1> {
+  using type = uint8_t;
+};
+template <> struct unsigned_key<2> {
+  using type = uint16_t;
+};
+template <> struct unsigned_key<4> {
+  using type = uint32_t;
+};
+template <> struct unsigned_key<8> {
+  using type = uint64_t;
+};
+
+/*!
+ * @brief Payload type of a keys-only sort, its arrays are never accessed
+ */
+struct no_values {};
+
+template <typename Task> class WorkStealingQueue;
+
+} // namespace detail
+
+template <typename T, unsigned RadixBits> class UniversalRadixSort;
+
+/*!
+ * @brief Scratch memory that sorts borrow and that persists across sorts
  *
- * @tparam T The data type to be sorted
+ * A sort carves every buffer it needs out of the workspace: the O(n)
+ * scratch arrays, histograms, staging lines and task deques. The buffers
+ * are handed back when the sort returns, but the memory is kept. The
+ * workspace grows to the largest sort it has served, so from then on
+ * sorting performs no heap allocations. The memory comes from a
+ * std::pmr::memory_resource. A workspace serves one sort at a time.
  *
  * @example
- * // Sort integers in ascending order
- * UniversalRadixSort<int>
- * sorter(UniversalRadixSort<int>::DataType::SIGNED_INTEGER); std::vector<int>
- * data = {170, -45, 75, -9000, 802, -24, 2, 66, 0, -1}; sorter.sort(data);
+ * // Keep one workspace for a hot loop of sorts
+ * radix::SortWorkspace workspace;
+ * UniversalRadixSort<uint64_t> sorter;
+ * sorter.set_workspace(workspace);
+ * for (auto &batch : batches) sorter.sort(batch);
  */
-template <typename T> class UniversalRadixSort {
+class SortWorkspace {
 public:
   /*!
-   * @brief Enumeration of supported data types
+   * @brief Create an empty workspace
+   *
+   * @param resource Memory resource to allocate from; it must outlive the
+   *                 workspace
    */
-  enum class DataType {
-    UNSIGNED_OR_STRING = 0, ///< Unsigned integers or fixed-length strings
-    SIGNED_INTEGER = 1,     ///< Signed integers
-    IEEE754_FLOAT = 2,      ///< IEEE 754 single-precision floating point
-    IEEE754_DOUBLE = 3      ///< IEEE 754 double-precision floating point
-  };
+  explicit SortWorkspace(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : resource_(resource), buffer_(nullptr), capacity_(0), used_(0),
+        demand_(0), peak_(0), wanted_(0), overflow_(nullptr),
+        overflowed_(false), depth_(0) {}
+
+  SortWorkspace(const SortWorkspace &) = delete;
+  SortWorkspace &operator=(const SortWorkspace &) = delete;
+
+  ~SortWorkspace() { release(); }
 
   /*!
-   * @brief Enumeration of sort direction
+   * @brief Grow the workspace ahead of the first sort
+   *
+   * @param bytes Capacity to provide
+   * @throw std::bad_alloc if the memory resource fails
    */
-  enum class Direction {
-    ASCENDING = true,  ///< Sort from smallest to largest
-    DESCENDING = false ///< Sort from largest to smallest
-  };
+  void reserve(const size_t bytes) {
+    if (bytes > capacity_) {
+      grow(bytes);
+    }
+  }
 
   /*!
-   * @brief Enumeration of byte processing order
+   * @brief Bytes a sort can borrow without allocating
    */
-  enum class ProcessingOrder {
-    LSB_FIRST = true, ///< Process from least significant byte to most
-    MSB_FIRST = false ///< Process from most significant byte to least
-  };
+  size_t capacity() const { return capacity_; }
 
   /*!
-   * @brief Enumeration of error codes
+   * @brief Return all memory to the memory resource
    */
-  enum class ErrorCode {
-    SUCCESS = 0,       ///< Operation completed successfully
-    NULL_POINTER = -1, ///< Null pointer passed as argument
-    INVALID_ELEMENT_SIZE =
-        -2, ///< Element size doesn't match data type requirements
-    MEMORY_ALLOCATION = -3,    ///< Failed to allocate required memory
-    UNSUPPORTED_DATA_TYPE = -4 ///< Data type is not supported
-  };
+  void release() {
+    free_overflow();
+    if (buffer_ != nullptr) {
+      resource_->deallocate(buffer_, capacity_, ALIGNMENT);
+      buffer_ = nullptr;
+    }
+    capacity_ = 0;
+  }
 
   /*!
-   * @brief Exception class for radix sort errors
+   * @brief Memory resource the workspace allocates from
    */
-  class RadixException : public std::runtime_error {
-  public:
-    explicit RadixException(ErrorCode code, const std::string &message)
-        : std::runtime_error(message), code_(code) {}
+  std::pmr::memory_resource *resource() const { return resource_; }
 
-    ErrorCode code() const { return code_; }
+private:
+  template <typename, unsigned> friend class UniversalRadixSort;
+  template <typename> friend class detail::WorkStealingQueue;
 
-  private:
-    ErrorCode code_;
-  };
+  /// Alignment of the workspace memory, one cache line
+  static constexpr size_t ALIGNMENT = 64;
 
   /*!
-   * @brief Constructor with configuration parameters
-   *
-   * @param dataType Type of data to be sorted (default: UNSIGNED_OR_STRING)
-   * @param order Byte processing order (default: LSB_FIRST)
-   * @param direction Sort direction (default: ASCENDING)
+   * @brief Header of a block allocated because the workspace was full
    */
-  explicit UniversalRadixSort(
-      DataType data_type = DataType::UNSIGNED_OR_STRING,
-      ProcessingOrder order = ProcessingOrder::LSB_FIRST,
-      Direction direction = Direction::ASCENDING)
-      : data_type_(data_type), processing_order_(order), direction_(direction) {
-  }
+  struct Overflow {
+    Overflow *next;   ///< Previously allocated block
+    size_t bytes;     ///< Block size including this header
+    size_t alignment; ///< Alignment the block was allocated with
+  };
 
   /*!
-   * @brief Sort an array of elements
+   * @brief Scope of one sort; its buffers are handed back when it ends
    *
-   * @param array Pointer to the array to be sorted
-   * @param n Number of elements in the array
-   * @throw RadixException if sorting fails
+   * Frames nest, for sorts run on behalf of another sort, and each hands
+   * back what was borrowed inside it. The outermost frame grows the
+   * workspace to what the previous sort needed, if the memory resource
+   * can provide it.
    */
-  void sort(T *array, const size_t n) {
-    if (array == nullptr) {
-      throw RadixException(ErrorCode::NULL_POINTER, "Array pointer is null");
-    }
-
-    if (n <= 1) {
-      return; // Nothing to sort
+  class Frame {
+  public:
+    explicit Frame(SortWorkspace &workspace) : workspace_(workspace) {
+      if (workspace_.depth_ == 0 && workspace_.wanted_ > workspace_.capacity_) {
+        try {
+          workspace_.grow(workspace_.wanted_);
+        } catch (const std::bad_alloc &) {
+          workspace_.wanted_ = workspace_.capacity_; // Borrow on demand
+        }
+      }
+      used_ = workspace_.used_;
+      demand_ = workspace_.demand_;
+      overflow_ = workspace_.overflow_;
+      ++workspace_.depth_;
     }
 
-    // Validate data type and element size compatibility
-    validate_data_type(sizeof(T));
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
 
-    bool need_post_processing = false;
+    ~Frame() {
+      --workspace_.depth_;
+      workspace_.rewind(used_, demand_, overflow_);
+    }
 
-    // Pre-processing based on data type
-    need_post_processing = pre_process_data(array, n);
+  private:
+    SortWorkspace &workspace_;
+    size_t used_;        ///< Bytes of the buffer in use on entry
+    size_t demand_;      ///< Bytes borrowed on entry
+    Overflow *overflow_; ///< Newest overflow block on entry
+  };
 
-    // Special handling for string sorting
-    if (data_type_ == DataType::UNSIGNED_OR_STRING &&
-        processing_order_ == ProcessingOrder::MSB_FIRST) {
-      radix_sort_strings(reinterpret_cast<char *>(array), n, sizeof(T));
-      return;
+  /*!
+   * @brief Array of U borrowed from the workspace for the current frame
+   *
+   * The elements are default-initialized, which leaves trivial types
+   * uninitialized, and destroyed with the array.
+   */
+  template <typename U> class Array {
+  public:
+    Array(SortWorkspace &workspace, const size_t count)
+        : data_(static_cast<U *>(
+              workspace.allocate(count * sizeof(U), alignof(U)))),
+          count_(count) {
+      std::uninitialized_default_construct_n(data_, count_);
     }
 
-    // Allocate temporary buffer for counting sort
-    std::unique_ptr<T[]> temp_array(new T[n]);
+    Array(const Array &) = delete;
+    Array &operator=(const Array &) = delete;
 
-    // Main sorting loop
-    if (processing_order_ == ProcessingOrder::LSB_FIRST) {
-      // LSB-first (right to left): optimal for numeric types
-      for (size_t byte_index = 0; byte_index < sizeof(T); ++byte_index) {
-        counting_sort_byte(array, n, byte_index, temp_array.get());
-      }
-    } else {
-      // MSB-first (left to right): optimal for fixed-length strings
-      for (size_t byte_index = 0; byte_index < sizeof(T); ++byte_index) {
-        counting_sort_byte(array, n, byte_index, temp_array.get());
-      }
-    }
+    ~Array() { std::destroy_n(data_, count_); }
 
-    // Post-processing to restore original representation
-    if (need_post_processing) {
-      post_process_data(array, n);
-    }
+    U *get() const { return data_; }
+    U &operator[](const size_t index) const { return data_[index]; }
 
-    // Apply reverse for descending order (for non-string types)
-    if (direction_ == Direction::DESCENDING &&
-        data_type_ != DataType::UNSIGNED_OR_STRING) {
-      reverse_array(array, n);
-    }
-  }
+  private:
+    U *data_;
+    size_t count_;
+  };
 
   /*!
-   * @brief Sort a vector of elements
+   * @brief Borrow memory until the outermost frame ends
    *
-   * @param vec Vector to be sorted
-   * @throw RadixException if sorting fails
+   * @param bytes Size of the buffer
+   * @param alignment Alignment of the buffer, a power of two
+   * @return Pointer to the buffer
+   * @throw std::bad_alloc if the workspace is full and the memory resource
+   *        fails
    */
-  void sort(std::vector<T> &vec) {
-    if (!vec.empty()) {
-      sort(vec.data(), vec.size());
+  void *allocate(const size_t bytes, const size_t alignment) {
+    const size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+    if (offset <= capacity_ && bytes <= capacity_ - offset) {
+      used_ = offset + bytes;
+      demand_ += bytes + alignment;
+      return buffer_ + offset;
     }
+
+    // Serve the buffer from its own block until the frame ends
+    const size_t block_alignment = std::max(alignment, alignof(Overflow));
+    const size_t header =
+        (sizeof(Overflow) + block_alignment - 1) & ~(block_alignment - 1);
+    void *block = resource_->allocate(header + bytes, block_alignment);
+    overflow_ =
+        new (block) Overflow{overflow_, header + bytes, block_alignment};
+    demand_ += bytes + alignment;
+    return static_cast<unsigned char *>(block) + header;
   }
 
   /*!
-   * @brief Validate data type compatibility with element size
+   * @brief Hand back the buffers of a frame
    *
-   * @param elementSize Size of each element in bytes
-   * @throw RadixException if validation fails
+   * When the outermost frame ends after the workspace overflowed, the
+   * peak demand of the sort becomes the size to grow to.
+   *
+   * @param used Bytes of the buffer in use when the frame began
+   * @param demand Bytes borrowed when the frame began
+   * @param overflow Newest overflow block when the frame began
    */
-  void validate_data_type(const size_t element_size) const {
-    switch (data_type_) {
-    case DataType::IEEE754_FLOAT:
-      if (element_size != sizeof(float)) {
-        throw RadixException(
-            ErrorCode::INVALID_ELEMENT_SIZE,
-            "Element size must match sizeof(float) for IEEE754_FLOAT");
-      }
-      break;
-    case DataType::IEEE754_DOUBLE:
-      if (element_size != sizeof(double)) {
-        throw RadixException(
-            ErrorCode::INVALID_ELEMENT_SIZE,
-            "Element size must match sizeof(double) for IEEE754_DOUBLE");
+  void rewind(const size_t used, const size_t demand, Overflow *overflow) {
+    peak_ = std::max(peak_, demand_);
+    while (overflow_ != overflow) {
+      Overflow *block = overflow_;
+      overflow_ = block->next;
+      resource_->deallocate(block, block->bytes, block->alignment);
+      overflowed_ = true;
+    }
+    used_ = used;
+    demand_ = demand;
+    if (depth_ == 0) {
+      if (overflowed_) {
+        wanted_ = std::max(wanted_, peak_);
       }
-      break;
-    case DataType::SIGNED_INTEGER:
-    case DataType::UNSIGNED_OR_STRING:
-      // No specific size requirements for these types
-      break;
-    default:
-      throw RadixException(ErrorCode::UNSUPPORTED_DATA_TYPE,
-                           "Unsupported data type");
+      peak_ = 0;
+      overflowed_ = false;
     }
   }
 
   /*!
-   * @brief Utility function to print integer array
+   * @brief Replace the buffer by a larger one, outside of any frame
+   *
+   * @param bytes New capacity
    */
-  static void print_array(const std::vector<int> &arr) {
-    for (size_t i = 0; i < arr.size(); ++i) {
-      std::cout << arr[i];
-      if (i < arr.size() - 1)
-        std::cout << " ";
+  void grow(const size_t bytes) {
+    if (buffer_ != nullptr) {
+      resource_->deallocate(buffer_, capacity_, ALIGNMENT);
+      buffer_ = nullptr;
+      capacity_ = 0;
     }
-    std::cout << std::endl;
+    buffer_ = static_cast<unsigned char *>(
+        resource_->allocate(bytes, ALIGNMENT));
+    capacity_ = bytes;
   }
 
   /*!
-   * @brief Utility function to print long array
+   * @brief Return the blocks allocated while the workspace was full
    */
-  static void print_array(const std::vector<long> &arr) {
-    for (size_t i = 0; i < arr.size(); ++i) {
-      std::cout << arr[i];
-      if (i < arr.size() - 1)
-        std::cout << " ";
+  void free_overflow() {
+    while (overflow_ != nullptr) {
+      Overflow *block = overflow_;
+      overflow_ = block->next;
+      resource_->deallocate(block, block->bytes, block->alignment);
     }
-    std::cout << std::endl;
   }
 
+  std::pmr::memory_resource *resource_; ///< Source of all memory
+  unsigned char *buffer_;               ///< Memory borrowed by sorts
+  size_t capacity_;                     ///< Size of buffer_
+  size_t used_;                         ///< Bytes of buffer_ in use
+  size_t demand_;    ///< Bytes the open frames borrowed, with padding
+  size_t peak_;      ///< Largest demand_ of the current sort
+  size_t wanted_;    ///< Capacity to grow to before the next sort
+  Overflow *overflow_; ///< Blocks allocated while buffer_ was full
+  bool overflowed_;    ///< Whether the current sort allocated blocks
+  size_t depth_;       ///< Number of open frames
+};
+
+/*!
+ * @brief Memory resource backing large buffers with transparent huge pages
+ *
+ * A radix pass scatters to RADIX_BASE places across the whole scratch
+ * buffer, so with 4 KB pages nearly every store of a large sort misses the
+ * TLB. Buffers of at least minBytes are mapped 2 MB aligned and advised
+ * with MADV_HUGEPAGE, so the kernel backs them with 2 MB pages. They can
+ * optionally be prefaulted so the first pass does not take the page
+ * faults. Smaller buffers, and every buffer on systems other than Linux,
+ * come from the upstream resource.
+ *
+ * @example
+ * // Workspace whose large buffers use prefaulted huge pages
+ * radix::HugePageResource huge_pages(true);
+ * radix::SortWorkspace workspace(&huge_pages);
+ */
+class HugePageResource : public std::pmr::memory_resource {
+public:
+  /// Size and alignment of a huge page
+  static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
   /*!
-   * @brief Utility function to print float array
+   * @brief Configure the resource
+   *
+   * @param prefault true to fault every page in when a buffer is mapped
+   * @param minBytes Smallest buffer mapped with huge pages
+   * @param upstream Resource serving smaller buffers; it must outlive this
    */
-  static void print_array(const std::vector<float> &arr) {
-    for (size_t i = 0; i < arr.size(); ++i) {
-      std::cout << std::fixed << std::setprecision(3) << arr[i];
-      if (i < arr.size() - 1)
-        std::cout << " ";
-    }
-    std::cout << std::endl;
-  }
+  explicit HugePageResource(
+      bool prefault = false, size_t min_bytes = HUGE_PAGE_SIZE,
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : prefault_(prefault), min_bytes_(min_bytes), upstream_(upstream) {}
 
+private:
   /*!
-   * @brief Utility function to print double array
+   * @brief Check whether a buffer is mapped by this resource
    */
-  static void print_array(const std::vector<double> &arr) {
-    for (size_t i = 0; i < arr.size(); ++i) {
-      std::cout << std::fixed << std::setprecision(6) << arr[i];
-      if (i < arr.size() - 1)
-        std::cout << " ";
+  bool maps(const size_t bytes, const size_t alignment) const {
+#ifdef __linux__
+    return bytes >= min_bytes_ && alignment <= HUGE_PAGE_SIZE;
+#else
+    (void)bytes;
+    (void)alignment;
+    return false;
+#endif
+  }
+
+  void *do_allocate(const size_t bytes, const size_t alignment) override {
+    if (!maps(bytes, alignment)) {
+      return upstream_->allocate(bytes, alignment);
     }
-    std::cout << std::endl;
+#ifdef __linux__
+    // Map one extra huge page, then trim the mapping to a 2 MB boundary
+    const size_t length = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    void *mapping = mmap(nullptr, length + HUGE_PAGE_SIZE,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+    const uintptr_t aligned =
+        (start + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+    if (aligned != start) {
+      munmap(mapping, aligned - start);
+    }
+    if (aligned + length != start + length + HUGE_PAGE_SIZE) {
+      munmap(reinterpret_cast<void *>(aligned + length),
+             start + HUGE_PAGE_SIZE - aligned);
+    }
+
+    void *buffer = reinterpret_cast<void *>(aligned);
+    madvise(buffer, length, MADV_HUGEPAGE);
+    if (prefault_) {
+      populate(buffer, length);
+    }
+    return buffer;
+#else
+    return nullptr;
+#endif
   }
 
-  /*!
-   * @brief Utility function to print string array
-   */
-  static void print_array(const std::vector<std::string> &arr) {
-    for (size_t i = 0; i < arr.size(); ++i) {
-      std::cout << "'" << arr[i] << "'";
-      if (i < arr.size() - 1)
-        std::cout << " ";
+  void do_deallocate(void *buffer, const size_t bytes,
+                     const size_t alignment) override {
+    if (!maps(bytes, alignment)) {
+      upstream_->deallocate(buffer, bytes, alignment);
+      return;
     }
-    std::cout << std::endl;
+#ifdef __linux__
+    munmap(buffer,
+           (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+#endif
   }
 
-private:
-  DataType data_type_;               ///< Type of data being sorted
-  ProcessingOrder processing_order_; ///< Byte processing order
-  Direction direction_;              ///< Sort direction
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
 
   /*!
-   * @brief Pre-process data based on data type
+   * @brief Fault in every page of a fresh mapping
    *
-   * @param array Pointer to the array to be processed
-   * @param n Number of elements
-   * @return true if post-processing is needed
+   * MAP_POPULATE would fault the pages before the mapping is aligned and
+   * advised, i.e. as 4 KB pages, so the pages are populated afterwards:
+   * with MADV_POPULATE_WRITE where the kernel has it, by touching them
+   * otherwise.
+   *
+   * @param buffer Start of the mapping
+   * @param length Length of the mapping
    */
-  bool pre_process_data(T *array, const size_t n) {
-    switch (data_type_) {
-    case DataType::IEEE754_FLOAT:
-      float_pre_post_processing(reinterpret_cast<float *>(array), n, true);
-      return true;
-    case DataType::IEEE754_DOUBLE:
-      double_pre_post_processing(reinterpret_cast<double *>(array), n, true);
-      return true;
-    case DataType::SIGNED_INTEGER:
-      flip_msb_for_signed_types(array, n);
-      return true;
-    default:
-      return false;
+  static void populate(void *buffer, const size_t length) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(buffer, length, MADV_POPULATE_WRITE) == 0) {
+      return;
+    }
+#endif
+    volatile unsigned char *bytes = static_cast<unsigned char *>(buffer);
+    for (size_t offset = 0; offset < length; offset += 4096) {
+      bytes[offset] = 0;
     }
   }
 
+  bool prefault_;                       ///< Fault pages in on allocation
+  size_t min_bytes_;                    ///< Smallest huge page buffer
+  std::pmr::memory_resource *upstream_; ///< Resource for other buffers
+};
+
+namespace detail {
+
+/*!
+ * @brief Per-worker task deques with work stealing
+ *
+ * A worker pushes and pops its own deque at the back, so it keeps working
+ * depth-first on the data it just touched, and steals from the front of
+ * the other deques, which hold the oldest and usually largest tasks. The
+ * queue counts tasks that are queued or running; it drains once a worker
+ * finishes the last task without having pushed new ones.
+ *
+ * @tparam Task Task description, copied in and out of the deques
+ */
+template <typename Task> class WorkStealingQueue {
+public:
   /*!
-   * @brief Post-process data to restore original representation
+   * @brief Create one fixed-size ring deque per worker
    *
-   * @param array Pointer to the array to be processed
-   * @param n Number of elements
+   * @param workers Number of workers
+   * @param capacity Most tasks queued at once, in any one deque
+   * @param workspace Workspace providing the deques
    */
-  void post_process_data(T *array, const size_t n) {
-    switch (data_type_) {
-    case DataType::IEEE754_FLOAT:
-      float_pre_post_processing(reinterpret_cast<float *>(array), n, false);
-      break;
-    case DataType::IEEE754_DOUBLE:
-      double_pre_post_processing(reinterpret_cast<double *>(array), n, false);
-      break;
-    case DataType::SIGNED_INTEGER:
-      flip_msb_for_signed_types(array, n);
-      break;
-    default:
-      break;
+  WorkStealingQueue(const size_t workers, const size_t capacity,
+                    SortWorkspace &workspace)
+      : deques_(workspace, workers), slots_(workspace, workers * capacity),
+        workers_(workers), capacity_(capacity), pending_(0),
+        cancelled_(false) {
+    for (size_t worker = 0; worker < workers; ++worker) {
+      deques_[worker].tasks = &slots_[worker * capacity];
     }
   }
 
   /*!
-   * @brief Flip MSB for signed integer types
+   * @brief Queue a task on a worker's deque
    *
-   * @param array Pointer to the array of signed integers
-   * @param n Number of elements
+   * @param worker Index of the pushing worker
+   * @param task Task to queue
    */
-  void flip_msb_for_signed_types(T *array, const size_t n) {
-    unsigned char *bytes = reinterpret_cast<unsigned char *>(array);
-    const unsigned char SIGN_BIT_MASK = 0x80; // 10000000 in binary
-
-    for (size_t i = 0; i < n; ++i) {
-      size_t mbs_index = i * sizeof(T) + (sizeof(T) - 1);
-      bytes[mbs_index] ^= SIGN_BIT_MASK;
-    }
+  void push(const size_t worker, const Task &task) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    Deque &own = deques_[worker];
+    std::lock_guard<std::mutex> guard(own.lock);
+    own.tasks[(own.head + own.size) % capacity_] = task;
+    ++own.size;
   }
 
   /*!
-   * @brief Pre/post processing for IEEE 754 float values
+   * @brief Take the newest own task, or steal the oldest task of another
    *
-   * @param array Pointer to the array of float values
-   * @param n Number of elements
-   * @param isPreprocess true for pre-processing, false for post-processing
+   * @param worker Index of the calling worker
+   * @param task Receives the task
+   * @return false if every deque is empty
    */
-  void float_pre_post_processing(float *array, const size_t n,
-                                 const bool is_pre_process) {
-    union FloatConverter {
-      float f;
-      uint32_t u32;
-    };
-
-    const uint32_t SIGN_BIT_MASK = 0x80000000U;
-
-    for (size_t i = 0; i < n; ++i) {
-      FloatConverter converter;
-      converter.f = array[i];
-
-      if (is_pre_process) {
-        // Convert to sortable representation
-        if (converter.u32 & SIGN_BIT_MASK) {
-          converter.u32 = ~converter.u32; // Negative values: flip all bits
-        } else {
-          converter.u32 ^= SIGN_BIT_MASK; // Positive values: flip sign bit only
-        }
-      } else {
-        // Restore original representation
-        if (converter.u32 & SIGN_BIT_MASK) {
-          converter.u32 ^= SIGN_BIT_MASK; // Was positive: flip sign bit back
-        } else {
-          converter.u32 = ~converter.u32; // Was negative: flip all bits back
-        }
+  bool pop(const size_t worker, Task &task) {
+    {
+      Deque &own = deques_[worker];
+      std::lock_guard<std::mutex> guard(own.lock);
+      if (own.size != 0) {
+        --own.size;
+        task = own.tasks[(own.head + own.size) % capacity_];
+        return true;
       }
-
-      array[i] = converter.f;
     }
+    for (size_t i = 1; i < workers_; ++i) {
+      Deque &victim = deques_[(worker + i) % workers_];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (victim.size != 0) {
+        task = victim.tasks[victim.head];
+        victim.head = (victim.head + 1) % capacity_;
+        --victim.size;
+        return true;
+      }
+    }
+    return false;
   }
 
   /*!
-   * @brief Pre/post processing for IEEE 754 double values
-   *
-   * @param array Pointer to the array of double values
-   * @param n Number of elements
-   * @param isPreprocess true for pre-processing, false for post-processing
+   * @brief Mark a popped task as finished, after pushing its subtasks
    */
-  void double_pre_post_processing(double *array, const size_t n,
-                                  const bool is_pre_process) {
-    union DoubleConverter {
-      double d;
-      uint64_t u64;
+  void finish() { pending_.fetch_sub(1, std::memory_order_acq_rel); }
+
+  /*!
+   * @brief Make every worker stop, e.g. after a task failed
+   */
+  void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  /*!
+   * @brief Check whether the workers can stop
+   *
+   * @return true once all tasks finished or the queue was cancelled
+   */
+  bool done() const {
+    return pending_.load(std::memory_order_acquire) == 0 ||
+           cancelled_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /*!
+   * @brief One worker's deque on its own cache line
+   */
+  struct alignas(64) Deque {
+    std::mutex lock;
+    Task *tasks = nullptr; ///< Ring of capacity_ slots
+    size_t head = 0;       ///< Slot of the oldest task
+    size_t size = 0;       ///< Number of queued tasks
+  };
+
+  SortWorkspace::Array<Deque> deques_; ///< One deque per worker
+  SortWorkspace::Array<Task> slots_;   ///< Ring storage of all deques
+  size_t workers_;                     ///< Number of deques
+  size_t capacity_;                    ///< Slots per deque
+  std::atomic<size_t> pending_;     ///< Tasks queued or running
+  std::atomic<bool> cancelled_;     ///< Set when the workers must stop
+};
+
+} // namespace detail
+
+/*!
+ * @brief Default digit width in bits for a key type
+ *
+ * 32-bit and 64-bit keys use 11-bit digits (3 and 6 passes) whose 2048-entry
+ * histograms still fit in L1; every other width keeps one byte per digit.
+ *
+ * @tparam T The data type to be sorted
+ */
+template <typename T> struct default_radix_bits {
+  static constexpr unsigned value =
+      (sizeof(T) == 4 || sizeof(T) == 8) ? 11U : 8U;
+};
+
+/*!
+ * @brief Compile-time description of a key type's encoding
+ *
+ * UniversalRadixSort uses these traits to infer the data type of T and to
+ * specialize its digit extraction with if constexpr. Specialize the
+ * template for wrapper types that should sort like a number, e.g. a
+ * 16-byte signed integer type that std::is_integral does not recognize.
+ *
+ * @tparam T The data type to be sorted
+ */
+template <typename T> struct radix_key_traits {
+  /// Encoding is fully determined by T (never sorted as a string)
+  static constexpr bool is_numeric = std::is_arithmetic<T>::value;
+  /// IEEE 754 sign-magnitude encoding
+  static constexpr bool is_floating_point = std::is_floating_point<T>::value;
+  /// Two's complement encoding
+  static constexpr bool is_signed_integer =
+      std::is_integral<T>::value && std::is_signed<T>::value;
+};
+
+/*!
+ * @brief Persistent worker threads for the parallel sorts
+ *
+ * The workers live as long as the pool, so a parallel sort only has to
+ * wake them. After a job a worker spins for a while before it parks on a
+ * condition variable, so back-to-back sorts start within microseconds
+ * while an idle pool costs no CPU. One job runs at a time; concurrent
+ * run() calls, e.g. from sorters sharing the pool, take turns.
+ *
+ * @example
+ * // Four threads pinned to CPUs 0-3, shared by every sorter
+ * auto pool = std::make_shared<radix::ThreadPool>(4, std::vector<int>{0, 1,
+ * 2, 3}); UniversalRadixSort<int64_t> sorter;
+ * sorter.set_execution(UniversalRadixSort<int64_t>::Execution::PARALLEL);
+ * sorter.set_thread_pool(pool);
+ */
+class ThreadPool {
+public:
+  /*!
+   * @brief Start the worker threads
+   *
+   * @param threads Threads running a job including the calling thread, 0
+   *                for std::thread::hardware_concurrency()
+   * @param cpus CPUs to pin worker i to, cpus[i % cpus.size()]; empty to
+   *             leave placement to the OS. Pinning is best effort and only
+   *             implemented on Linux: workers whose CPU is negative, at
+   *             least CPU_SETSIZE or refused by the OS run unpinned, see
+   *             pinned().
+   * @throw std::system_error if a thread cannot be started
+   */
+  explicit ThreadPool(size_t threads = 0, const std::vector<int> &cpus = {})
+      : pinned_(0), invoke_(nullptr), context_(nullptr), tasks_(0),
+        generation_(0), next_(0), finished_(0), stopping_(false) {
+    if (threads == 0) {
+      threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threads - 1);
+    try {
+      for (size_t i = 0; i + 1 < threads; ++i) {
+        workers_.emplace_back(&ThreadPool::work, this);
+        if (!cpus.empty() && pin(workers_.back(), cpus[i % cpus.size()])) {
+          ++pinned_;
+        }
+      }
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() { stop(); }
+
+  /*!
+   * @brief Number of threads running a job, including the caller
+   */
+  size_t size() const { return workers_.size() + 1; }
+
+  /*!
+   * @brief Number of workers pinned to the CPU they were given
+   */
+  size_t pinned() const { return pinned_; }
+
+  /*!
+   * @brief Run task(0) to task(tasks - 1) on the pool and wait for all
+   *
+   * The calling thread works on the job too. Tasks must not call run() on
+   * the same pool. The first exception thrown by a task is rethrown once
+   * every task has finished.
+   *
+   * @param tasks Number of tasks
+   * @param task Callable taking the task index
+   */
+  template <typename Task> void run(const size_t tasks, const Task &task) {
+    std::lock_guard<std::mutex> job_guard(job_lock_);
+    invoke_ = [](const void *context, const size_t index) {
+      (*static_cast<const Task *>(context))(index);
+    };
+    context_ = &task;
+    tasks_ = tasks;
+    error_ = nullptr;
+    next_.store(0, std::memory_order_relaxed);
+    finished_.store(0, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> park_guard(park_lock_);
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    park_signal_.notify_all();
+
+    work_on_job();
+
+    // Every worker takes part in every job, so once all of them are done
+    // no one reads this job's state any more
+    for (unsigned spins = 0; finished_.load(std::memory_order_acquire) !=
+                             workers_.size();
+         ++spins) {
+      if (spins < SPIN_LIMIT) {
+        pause();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+private:
+  /// Polls of a spinning thread before it parks or yields
+  static constexpr unsigned SPIN_LIMIT = 1U << 10;
+
+  /*!
+   * @brief Hint the CPU that the thread is spinning
+   */
+  static void pause() {
+#ifdef UNIVERSAL_RADIX_SORT_HAS_SSE2
+    _mm_pause();
+#endif
+  }
+
+  /*!
+   * @brief Restrict a thread to one CPU
+   *
+   * @param thread Thread to pin
+   * @param cpu CPU index
+   * @return false if the CPU is out of range or the OS refused, leaving
+   *         the thread unpinned
+   */
+  static bool pin(std::thread &thread, const int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return false; // Not representable in a cpu_set_t
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set),
+                                  &set) == 0;
+#else
+    (void)thread;
+    (void)cpu;
+    return false;
+#endif
+  }
+
+  /*!
+   * @brief Claim and run tasks of the current job until none are left
+   */
+  void work_on_job() {
+    for (;;) {
+      const size_t index = next_.fetch_add(1, std::memory_order_relaxed);
+      if (index >= tasks_) {
+        return;
+      }
+      try {
+        invoke_(context_, index);
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(error_lock_);
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+    }
+  }
+
+  /*!
+   * @brief Worker loop: wait for a job, spinning and then parked
+   */
+  void work() {
+    uint64_t seen = 0;
+    for (;;) {
+      for (unsigned spins = 0;
+           spins < SPIN_LIMIT &&
+           generation_.load(std::memory_order_acquire) == seen;
+           ++spins) {
+        pause();
+      }
+      if (generation_.load(std::memory_order_acquire) == seen) {
+        std::unique_lock<std::mutex> park_guard(park_lock_);
+        park_signal_.wait(park_guard, [&] {
+          return generation_.load(std::memory_order_acquire) != seen;
+        });
+      }
+      seen = generation_.load(std::memory_order_acquire);
+      if (stopping_) {
+        return;
+      }
+      work_on_job();
+      finished_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  /*!
+   * @brief Wake every worker with the stop flag set and join them
+   */
+  void stop() {
+    {
+      std::lock_guard<std::mutex> park_guard(park_lock_);
+      stopping_ = true;
+      generation_.fetch_add(1, std::memory_order_release);
+    }
+    park_signal_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  std::vector<std::thread> workers_; ///< Threads besides the caller
+  size_t pinned_;                    ///< Workers pinned to their CPU
+  std::mutex job_lock_;              ///< Serializes run() calls
+
+  // State of the current job, written by run() before it bumps generation_
+  void (*invoke_)(const void *, size_t); ///< Calls the type-erased task
+  const void *context_;                  ///< The task callable
+  size_t tasks_;                         ///< Number of task indices
+  std::exception_ptr error_;             ///< First exception of a task
+  std::mutex error_lock_;                ///< Guards error_
+
+  std::atomic<uint64_t> generation_; ///< Bumped to publish a job
+  std::atomic<size_t> next_;         ///< Next unclaimed task index
+  std::atomic<size_t> finished_;     ///< Workers done with the job
+  bool stopping_;                    ///< Set under park_lock_ to stop
+  std::mutex park_lock_;             ///< Guards parking and generation_ bumps
+  std::condition_variable park_signal_; ///< Wakes parked workers
+};
+
+/*!
+ * @brief Universal Radix Sort implementation with class-based design
+ *
+ * This class template provides a flexible and type-safe implementation of
+ * radix sort for various data types including signed integers, floating-point
+ * numbers, and strings.
+ *
+ * @tparam T The data type to be sorted
+ * @tparam RadixBits Digit width in bits (1-16). Fewer, wider digits mean
+ *                   fewer passes but larger histograms; widths other than 8
+ *                   require a key of 1, 2, 4 or 8 bytes.
+ *
+ * @example
+ * // Sort integers in ascending order, the data type is inferred from int
+ * UniversalRadixSort<int> sorter;
+ * std::vector<int> data = {170, -45, 75, -9000, 802, -24, 2, 66, 0, -1};
+ * sorter.sort(data);
+ */
+template <typename T, unsigned RadixBits = default_radix_bits<T>::value>
+class UniversalRadixSort {
+  static_assert(RadixBits >= 1 && RadixBits <= 16,
+                "RadixBits must be between 1 and 16");
+  static_assert(RadixBits == 8 ||
+                    !std::is_void<
+                        typename detail::unsigned_key<sizeof(T)>::type>::value,
+                "Digits other than 8 bits need a 1, 2, 4 or 8 byte key");
+  static_assert(!radix_key_traits<T>::is_floating_point || sizeof(T) == 4 ||
+                    sizeof(T) == 8,
+                "Only 32-bit and 64-bit IEEE 754 keys are supported");
+
+public:
+  static constexpr unsigned RADIX_BITS = RadixBits; ///< Digit width in bits
+
+  /*!
+   * @brief Enumeration of supported data types
+   */
+  enum class DataType {
+    UNSIGNED_OR_STRING = 0, ///< Unsigned integers or fixed-length strings
+    SIGNED_INTEGER = 1,     ///< Signed integers
+    IEEE754_FLOAT = 2,      ///< IEEE 754 single-precision floating point
+    IEEE754_DOUBLE = 3      ///< IEEE 754 double-precision floating point
+  };
+
+  /*!
+   * @brief Enumeration of sort direction
+   */
+  enum class Direction {
+    ASCENDING = true,  ///< Sort from smallest to largest
+    DESCENDING = false ///< Sort from largest to smallest
+  };
+
+  /*!
+   * @brief Enumeration of byte processing order
+   */
+  enum class ProcessingOrder {
+    LSB_FIRST = true, ///< Process from least significant byte to most
+    MSB_FIRST = false ///< Process from most significant byte to least
+  };
+
+  /*!
+   * @brief Enumeration of stability guarantees
+   */
+  enum class Stability {
+    STABLE = 0,  ///< Equal keys keep their order; needs an O(n) buffer
+    UNSTABLE = 1 ///< In-place MSD permutation with no O(n) buffer
+  };
+
+  /*!
+   * @brief Enumeration of scatter strategies for the counting passes
+   */
+  enum class ScatterMode {
+    AUTO = 0,           ///< Write-combine once the data dwarfs the LLC
+    DIRECT = 1,         ///< Store every element straight to its bucket
+    WRITE_COMBINING = 2 ///< Stage cache lines per bucket, stream them out
+  };
+
+  /*!
+   * @brief Enumeration of execution policies
+   */
+  enum class Execution {
+    SEQUENTIAL = 0, ///< Sort on the calling thread
+    PARALLEL = 1    ///< Split counting and scatter across worker threads
+  };
+
+  /*!
+   * @brief Enumeration of page policies for large scratch buffers
+   */
+  enum class HugePages {
+    DISABLED = 0,  ///< Allocate from the default memory resource
+    ENABLED = 1,   ///< 2 MB aligned buffers advised with MADV_HUGEPAGE
+    PREFAULTED = 2 ///< Huge page buffers faulted in when allocated
+  };
+
+  /*!
+   * @brief Enumeration of error codes
+   */
+  enum class ErrorCode {
+    SUCCESS = 0,       ///< Operation completed successfully
+    NULL_POINTER = -1, ///< Null pointer passed as argument
+    INVALID_ELEMENT_SIZE =
+        -2, ///< Element size doesn't match data type requirements
+    MEMORY_ALLOCATION = -3,     ///< Failed to allocate required memory
+    UNSUPPORTED_DATA_TYPE = -4, ///< Data type is not supported
+    INVALID_ARGUMENT = -5,      ///< Rank, quantile or count out of range
+    FILE_IO = -6                ///< Failed to read or write a file
+  };
+
+  /*!
+   * @brief Exception class for radix sort errors
+   */
+  class RadixException : public std::runtime_error {
+  public:
+    explicit RadixException(ErrorCode code, const std::string &message)
+        : std::runtime_error(message), code_(code) {}
+
+    ErrorCode code() const { return code_; }
+
+  private:
+    ErrorCode code_;
+  };
+
+  /*!
+   * @brief Data type inferred from radix_key_traits<T>
+   *
+   * @return IEEE754_FLOAT or IEEE754_DOUBLE for floating point keys,
+   *         SIGNED_INTEGER for signed integers, UNSIGNED_OR_STRING otherwise
+   */
+  static constexpr DataType default_data_type() {
+    if constexpr (radix_key_traits<T>::is_floating_point) {
+      return sizeof(T) == sizeof(float) ? DataType::IEEE754_FLOAT
+                                        : DataType::IEEE754_DOUBLE;
+    } else if constexpr (radix_key_traits<T>::is_signed_integer) {
+      return DataType::SIGNED_INTEGER;
+    } else {
+      return DataType::UNSIGNED_OR_STRING;
+    }
+  }
+
+  /*!
+   * @brief Constructor with configuration parameters
+   *
+   * @param dataType Type of data to be sorted (default: inferred from T)
+   * @param order Byte processing order (default: LSB_FIRST)
+   * @param direction Sort direction (default: ASCENDING)
+   * @throw RadixException if the data type does not fit T
+   */
+  explicit UniversalRadixSort(
+      DataType data_type = default_data_type(),
+      ProcessingOrder order = ProcessingOrder::LSB_FIRST,
+      Direction direction = Direction::ASCENDING)
+      : data_type_(data_type), processing_order_(order), direction_(direction),
+        scatter_mode_(ScatterMode::AUTO), stability_(Stability::STABLE),
+        execution_(Execution::SEQUENTIAL), thread_count_(0),
+        memory_budget_(0) {
+    validate_data_type(sizeof(T));
+    init_key_transform();
+  }
+
+  /*!
+   * @brief Constructor inferring the data type from radix_key_traits<T>
+   *
+   * @param order Byte processing order
+   * @param direction Sort direction (default: ASCENDING)
+   */
+  explicit UniversalRadixSort(ProcessingOrder order,
+                              Direction direction = Direction::ASCENDING)
+      : UniversalRadixSort(default_data_type(), order, direction) {}
+
+  /*!
+   * @brief Select how the counting passes write elements to their buckets
+   *
+   * @param mode Scatter strategy (default: AUTO)
+   */
+  void set_scatter_mode(ScatterMode mode) { scatter_mode_ = mode; }
+
+  /*!
+   * @brief Whether counting passes can write-combine at all
+   *
+   * Elements must tile a cache line and the digit must have at most 2048
+   * buckets; otherwise every scatter mode stores elements directly.
+   */
+  static constexpr bool can_write_combine() {
+    return LINE_ELEMENTS != 0 && RADIX_BASE <= MAX_WRITE_COMBINING_BASE;
+  }
+
+  /*!
+   * @brief Select whether equal keys must keep their relative order
+   *
+   * UNSTABLE sorts in place with an MSB-first permutation (American flag
+   * sort) regardless of the processing order, so peak memory stays at the
+   * array itself plus the digit histograms.
+   *
+   * @param stability Stability guarantee (default: STABLE)
+   */
+  void set_stability(Stability stability) { stability_ = stability; }
+
+  /*!
+   * @brief Select whether sort() runs on several threads
+   *
+   * PARALLEL splits the histograms and the stable LSB-first passes across
+   * threads. Stable MSB-first sorts partition the top digit cooperatively
+   * and then recurse into the buckets on a work-stealing scheduler. The
+   * output is identical to a sequential sort for any thread count. Arrays
+   * too small to amortize the threads are sorted sequentially.
+   *
+   * @param execution Execution policy (default: SEQUENTIAL)
+   */
+  void set_execution(Execution execution) { execution_ = execution; }
+
+  /*!
+   * @brief Set the number of threads used by parallel execution
+   *
+   * The sorter starts its own ThreadPool of this size on the first
+   * parallel sort and keeps it for later sorts. Any pool set before is
+   * released.
+   *
+   * @param threads Thread count, 0 for std::thread::hardware_concurrency()
+   */
+  void set_thread_count(size_t threads) {
+    thread_count_ = threads;
+    thread_pool_.reset();
+  }
+
+  /*!
+   * @brief Run parallel sorts on a shared pool
+   *
+   * The sorter keeps the pool alive; copies of the sorter share it.
+   *
+   * @param pool Pool to use, null to fall back to a pool of its own
+   */
+  void set_thread_pool(std::shared_ptr<ThreadPool> pool) {
+    thread_pool_ = std::move(pool);
+  }
+
+  /*!
+   * @brief Run parallel sorts on a pool owned by the caller
+   *
+   * @param pool Pool to use; it must outlive every sort using it
+   */
+  void set_thread_pool(ThreadPool &pool) {
+    thread_pool_ = std::shared_ptr<ThreadPool>(std::shared_ptr<ThreadPool>(),
+                                               &pool);
+  }
+
+  /*!
+   * @brief Back large scratch buffers with transparent huge pages
+   *
+   * Applies to sorts without a workspace; a workspace takes its memory
+   * from the resource it was created with, e.g. a HugePageResource.
+   *
+   * @param hugePages Page policy (default: DISABLED)
+   */
+  void set_huge_pages(HugePages huge_pages) {
+    if (huge_pages == HugePages::DISABLED) {
+      scratch_resource_.reset();
+    } else {
+      scratch_resource_ = std::make_shared<HugePageResource>(
+          huge_pages == HugePages::PREFAULTED);
+    }
+  }
+
+  /*!
+   * @brief Limit the O(n) scratch buffers of a stable sort
+   *
+   * A stable sort whose scratch buffers would exceed the budget sorts runs
+   * that fit it and merges them through a buffer of the same size. The
+   * same happens with runs of half the size when the scratch buffers
+   * cannot be allocated. Histograms and other buffers whose size does not
+   * grow with n are not counted; argsort needs a copy of the keys besides.
+   *
+   * @param bytes Scratch memory budget, 0 for no limit (default: 0)
+   */
+  void set_memory_budget(const size_t bytes) { memory_budget_ = bytes; }
+
+  /*!
+   * @brief Borrow scratch memory from a shared workspace
+   *
+   * Without a workspace every sort allocates its buffers and frees them
+   * before returning. Copies of the sorter share the workspace, so they
+   * must not sort concurrently.
+   *
+   * @param workspace Workspace to use, null to allocate per sort
+   */
+  void set_workspace(std::shared_ptr<SortWorkspace> workspace) {
+    workspace_ = std::move(workspace);
+  }
+
+  /*!
+   * @brief Borrow scratch memory from a workspace owned by the caller
+   *
+   * @param workspace Workspace to use; it must outlive every sort using it
+   */
+  void set_workspace(SortWorkspace &workspace) {
+    workspace_ = std::shared_ptr<SortWorkspace>(
+        std::shared_ptr<SortWorkspace>(), &workspace);
+  }
+
+  /*!
+   * @brief Sort an array of elements
+   *
+   * @param array Pointer to the array to be sorted
+   * @param n Number of elements in the array
+   * @throw RadixException if sorting fails, with MEMORY_ALLOCATION if not
+   *        even the memory of a merge of small runs can be allocated
+   */
+  void sort(T *array, const size_t n) {
+    with_workspace([&](SortWorkspace &workspace) {
+      sort_elements(array, static_cast<detail::no_values *>(nullptr), n,
+                    stability_, workspace);
+    });
+  }
+
+  /*!
+   * @brief Sort a vector of elements
+   *
+   * @param vec Vector to be sorted
+   * @throw RadixException if sorting fails
+   */
+  void sort(std::vector<T> &vec) {
+    if (!vec.empty()) {
+      sort(vec.data(), vec.size());
+    }
+  }
+
+  /*!
+   * @brief Sort keys and reorder a payload array alongside them
+   *
+   * The arrays form a structure of arrays: values[i] belongs to keys[i].
+   * Digits are extracted from the keys only, and every value moves to the
+   * position its key moves to, so the payload is never histogrammed.
+   * Stability and direction follow the sorter's configuration.
+   *
+   * @tparam V Payload type, default constructible and move assignable
+   * @param keys Pointer to the keys to be sorted
+   * @param values Pointer to the payload, one value per key
+   * @param n Number of keys and values
+   * @throw RadixException if sorting fails
+   */
+  template <typename V> void sort(T *keys, V *values, const size_t n) {
+    if (values == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Value pointer is null");
+    }
+    with_workspace([&](SortWorkspace &workspace) {
+      sort_elements(keys, values, n, stability_, workspace);
+    });
+  }
+
+  /*!
+   * @brief Sort a vector of keys and reorder a vector of values alongside
+   *
+   * @tparam V Payload type, default constructible and move assignable
+   * @param keys Vector of keys to be sorted
+   * @param values Vector of values, as long as keys
+   * @throw RadixException if the lengths differ or sorting fails
+   */
+  template <typename V>
+  void sort(std::vector<T> &keys, std::vector<V> &values) {
+    if (keys.size() != values.size()) {
+      throw RadixException(ErrorCode::INVALID_ELEMENT_SIZE,
+                           "Key and value vectors differ in length");
+    }
+    if (!keys.empty()) {
+      sort(keys.data(), values.data(), keys.size());
+    }
+  }
+
+  /*!
+   * @brief Compute the stable sorting permutation of an array
+   *
+   * On return keys[perm[0]], keys[perm[1]], ... is the sorted sequence and
+   * equal keys keep their input order, whatever the configured stability.
+   * The keys are not modified: the digit passes run on a private copy that
+   * carries the indices as its payload.
+   *
+   * @param keys Pointer to the keys to be ranked
+   * @param n Number of keys, below 2^32
+   * @param perm Output array of n indices
+   * @throw RadixException with INVALID_ARGUMENT if n does not fit 32-bit
+   *        indices, or if sorting fails
+   */
+  void argsort(const T *keys, const size_t n, uint32_t *perm) {
+    if (n > size_t(UINT32_MAX)) {
+      throw RadixException(ErrorCode::INVALID_ARGUMENT,
+                           "Too many elements for 32-bit indices");
+    }
+    with_workspace([&](SortWorkspace &workspace) {
+      argsort_indices(keys, n, perm, workspace);
+    });
+  }
+
+  /*!
+   * @brief Compute the stable sorting permutation of an array of any size
+   *
+   * @param keys Pointer to the keys to be ranked
+   * @param n Number of keys
+   * @param perm Output array of n indices
+   * @throw RadixException if sorting fails
+   */
+  void argsort(const T *keys, const size_t n, size_t *perm) {
+    with_workspace([&](SortWorkspace &workspace) {
+      argsort_indices(keys, n, perm, workspace);
+    });
+  }
+
+  /*!
+   * @brief Sort only the first k elements of an array
+   *
+   * On return array[0, k) holds the k elements that sort first, in sorted
+   * order, and array[k, n) the others in unspecified order. Small k is
+   * selected with a heap of the k smallest keys in one read of the array.
+   * Larger k narrows the k-th key down from the most significant digit,
+   * dropping the elements past its bucket at every digit. Only the
+   * survivors are sorted, with the configured stability. String sorts and
+   * keys of unusual size sort the whole array.
+   *
+   * @param array Pointer to the array
+   * @param n Number of elements in the array
+   * @param k Number of leading elements to sort; values above n sort all
+   * @throw RadixException if sorting fails
+   */
+  void partial_sort(T *array, const size_t n, const size_t k) {
+    with_workspace([&](SortWorkspace &workspace) {
+      partial_sort_elements(array, static_cast<detail::no_values *>(nullptr),
+                            n, k, workspace);
+    });
+  }
+
+  /*!
+   * @brief Sort only the first k elements of a vector
+   *
+   * @param vec Vector to partially sort
+   * @param k Number of leading elements to sort
+   * @throw RadixException if sorting fails
+   */
+  void partial_sort(std::vector<T> &vec, const size_t k) {
+    if (!vec.empty()) {
+      partial_sort(vec.data(), vec.size(), k);
+    }
+  }
+
+  /*!
+   * @brief Sort only the first k keys, moving a payload alongside
+   *
+   * @tparam V Payload type, default constructible and move assignable
+   * @param keys Pointer to the keys
+   * @param values Pointer to the payload, one value per key
+   * @param n Number of keys and values
+   * @param k Number of leading elements to sort
+   * @throw RadixException if sorting fails
+   */
+  template <typename V>
+  void partial_sort(T *keys, V *values, const size_t n, const size_t k) {
+    if (values == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Value pointer is null");
+    }
+    with_workspace([&](SortWorkspace &workspace) {
+      partial_sort_elements(keys, values, n, k, workspace);
+    });
+  }
+
+  /*!
+   * @brief Sort only the first k keys of a vector, moving values alongside
+   *
+   * @tparam V Payload type, default constructible and move assignable
+   * @param keys Vector of keys
+   * @param values Vector of values, as long as keys
+   * @param k Number of leading elements to sort
+   * @throw RadixException if the lengths differ or sorting fails
+   */
+  template <typename V>
+  void partial_sort(std::vector<T> &keys, std::vector<V> &values,
+                    const size_t k) {
+    if (keys.size() != values.size()) {
+      throw RadixException(ErrorCode::INVALID_ELEMENT_SIZE,
+                           "Key and value vectors differ in length");
+    }
+    if (!keys.empty()) {
+      partial_sort(keys.data(), values.data(), keys.size(), k);
+    }
+  }
+
+  /*!
+   * @brief Find the element of a given rank without moving the array
+   *
+   * Unlike std::nth_element the array is left as it is: the rank's key is
+   * narrowed down one digit at a time, each digit costing one histogram
+   * over the elements that share the digits found so far. Those
+   * candidates are copied aside once they are few, into scratch memory
+   * borrowed like a sort's.
+   *
+   * @param array Pointer to the array
+   * @param n Number of elements in the array
+   * @param rank Position of the element in sorted order, below n
+   * @return Element that a sort would place at array[rank]
+   * @throw RadixException if the rank is out of range
+   */
+  T nth_element(const T *array, const size_t n, const size_t rank) {
+    if (rank >= n) {
+      throw RadixException(ErrorCode::INVALID_ARGUMENT, "Rank out of range");
+    }
+    T selected;
+    select_ranks(array, n, 1, [rank](size_t) { return rank; }, &selected);
+    return selected;
+  }
+
+  /*!
+   * @brief Find the element of a given rank in a vector
+   *
+   * @param vec Vector to search, left unchanged
+   * @param rank Position of the element in sorted order
+   * @return Element that a sort would place at vec[rank]
+   * @throw RadixException if the rank is out of range
+   */
+  T nth_element(const std::vector<T> &vec, const size_t rank) {
+    return nth_element(vec.data(), vec.size(), rank);
+  }
+
+  /*!
+   * @brief Find several quantiles in one narrowing without moving the array
+   *
+   * Quantile q is the element of rank ceil(q * n) - 1, or 0 for q = 0, in
+   * the sorter's direction. All ranks are narrowed together, so each digit
+   * reads the candidates once, however many quantiles are asked for. The
+   * returned vector is the only memory not borrowed like a sort's.
+   *
+   * @param array Pointer to the array
+   * @param n Number of elements in the array
+   * @param fractions Quantiles to find, each within [0, 1]
+   * @return Element of each quantile, in the order of fractions
+   * @throw RadixException if a fraction is out of range or n is 0
+   */
+  std::vector<T> quantiles(const T *array, const size_t n,
+                           const std::vector<double> &fractions) {
+    for (const double fraction : fractions) {
+      if (!(fraction >= 0.0 && fraction <= 1.0)) {
+        throw RadixException(ErrorCode::INVALID_ARGUMENT,
+                             "Quantile outside [0, 1]");
+      }
+      if (n == 0) {
+        throw RadixException(ErrorCode::INVALID_ARGUMENT,
+                             "No quantile of an empty array");
+      }
+    }
+    std::vector<T> selected(fractions.size());
+    select_ranks(
+        array, n, fractions.size(),
+        [&](const size_t i) {
+          const double rank = std::ceil(fractions[i] * static_cast<double>(n));
+          return rank < 1.0 ? 0
+                            : std::min(static_cast<size_t>(rank) - 1, n - 1);
+        },
+        selected.data());
+    return selected;
+  }
+
+  /*!
+   * @brief Find several quantiles of a vector
+   *
+   * @param vec Vector to search, left unchanged
+   * @param fractions Quantiles to find, each within [0, 1]
+   * @return Element of each quantile, in the order of fractions
+   * @throw RadixException if a fraction is out of range or vec is empty
+   */
+  std::vector<T> quantiles(const std::vector<T> &vec,
+                           const std::vector<double> &fractions) {
+    return quantiles(vec.data(), vec.size(), fractions);
+  }
+
+  /*!
+   * @brief Compare two elements in the order this sorter sorts them
+   *
+   * @param a First element
+   * @param b Second element
+   * @return true if a sorts before b
+   */
+  bool precedes(const T &a, const T &b) const { return element_less(a, b); }
+
+  /*!
+   * @brief Validate data type compatibility with element size
+   *
+   * Called once by the constructor. Numeric key types only sort with the
+   * data type inferred from radix_key_traits<T>, so a float cannot sort as
+   * an integer, nor a signed integer as an unsigned one or vice versa.
+   * The data type is a run-time value, so these mismatches throw rather
+   * than fail to compile.
+   *
+   * @param elementSize Size of each element in bytes
+   * @throw RadixException if validation fails
+   */
+  void validate_data_type(const size_t element_size) const {
+    if constexpr (radix_key_traits<T>::is_numeric) {
+      if (data_type_ != default_data_type()) {
+        throw RadixException(
+            ErrorCode::UNSUPPORTED_DATA_TYPE,
+            "Data type does not match the encoding of the key type");
+      }
+    }
+
+    switch (data_type_) {
+    case DataType::IEEE754_FLOAT:
+      if (element_size != sizeof(float)) {
+        throw RadixException(
+            ErrorCode::INVALID_ELEMENT_SIZE,
+            "Element size must match sizeof(float) for IEEE754_FLOAT");
+      }
+      break;
+    case DataType::IEEE754_DOUBLE:
+      if (element_size != sizeof(double)) {
+        throw RadixException(
+            ErrorCode::INVALID_ELEMENT_SIZE,
+            "Element size must match sizeof(double) for IEEE754_DOUBLE");
+      }
+      break;
+    case DataType::SIGNED_INTEGER:
+    case DataType::UNSIGNED_OR_STRING:
+      // No specific size requirements for these types
+      break;
+    default:
+      throw RadixException(ErrorCode::UNSUPPORTED_DATA_TYPE,
+                           "Unsupported data type");
+    }
+  }
+
+  /*!
+   * @brief Utility function to print integer array
+   */
+  static void print_array(const std::vector<int> &arr) {
+    for (size_t i = 0; i < arr.size(); ++i) {
+      std::cout << arr[i];
+      if (i < arr.size() - 1)
+        std::cout << " ";
+    }
+    std::cout << std::endl;
+  }
+
+  /*!
+   * @brief Utility function to print long array
+   */
+  static void print_array(const std::vector<long> &arr) {
+    for (size_t i = 0; i < arr.size(); ++i) {
+      std::cout << arr[i];
+      if (i < arr.size() - 1)
+        std::cout << " ";
+    }
+    std::cout << std::endl;
+  }
+
+  /*!
+   * @brief Utility function to print float array
+   */
+  static void print_array(const std::vector<float> &arr) {
+    for (size_t i = 0; i < arr.size(); ++i) {
+      std::cout << std::fixed << std::setprecision(3) << arr[i];
+      if (i < arr.size() - 1)
+        std::cout << " ";
+    }
+    std::cout << std::endl;
+  }
+
+  /*!
+   * @brief Utility function to print double array
+   */
+  static void print_array(const std::vector<double> &arr) {
+    for (size_t i = 0; i < arr.size(); ++i) {
+      std::cout << std::fixed << std::setprecision(6) << arr[i];
+      if (i < arr.size() - 1)
+        std::cout << " ";
+    }
+    std::cout << std::endl;
+  }
+
+  /*!
+   * @brief Utility function to print string array
+   */
+  static void print_array(const std::vector<std::string> &arr) {
+    for (size_t i = 0; i < arr.size(); ++i) {
+      std::cout << "'" << arr[i] << "'";
+      if (i < arr.size() - 1)
+        std::cout << " ";
+    }
+    std::cout << std::endl;
+  }
+
+private:
+  /// Same-width unsigned integer of T, or void when T is sorted bytewise
+  using key_type = typename detail::unsigned_key<sizeof(T)>::type;
+
+  static constexpr bool NATIVE_KEY = !std::is_void<key_type>::value;
+  static constexpr size_t RADIX_BASE = size_t(1) << RadixBits; ///< Buckets
+  static constexpr size_t RADIX_MASK = RADIX_BASE - 1;
+  static constexpr size_t PASS_COUNT =
+      (sizeof(T) * 8 + RadixBits - 1) / RadixBits; ///< Digits per key
+
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+  /// Element count per staged cache line, 0 if T does not tile a line
+  static constexpr size_t LINE_ELEMENTS =
+      (sizeof(T) <= CACHE_LINE_SIZE && CACHE_LINE_SIZE % sizeof(T) == 0)
+          ? CACHE_LINE_SIZE / sizeof(T)
+          : 0;
+  /// Interleaved sub-histograms per digit; narrower digits afford more
+  static constexpr size_t HISTOGRAM_LANES =
+      RADIX_BASE <= 256 ? 4 : (RADIX_BASE <= 2048 ? 2 : 1);
+  /// Elements counted into 32-bit lane counters before folding them
+  static constexpr size_t HISTOGRAM_CHUNK = size_t(1) << 31;
+  /// Bucket size below which the MSD engine finishes with insertion sort
+  static constexpr size_t MSD_SMALL_SORT_THRESHOLD = 64;
+  /// Partial sorts of at most n / HEAP_SELECT_RATIO elements select with a
+  /// heap instead of narrowing digits
+  static constexpr size_t HEAP_SELECT_RATIO = 512;
+  /// Natural runs up to which presorted input is merged, not radix sorted:
+  /// a merge level costs about two digit passes
+  static constexpr size_t MAX_NATURAL_RUNS = size_t(1)
+                                             << ((PASS_COUNT + 1) / 2);
+  /// Neighbour comparisons per block of the presortedness scan
+  static constexpr size_t PRESORTED_SCAN_BLOCK = 1024;
+  /// Data size above which AUTO streams the scatter past the caches
+  static constexpr size_t STREAMING_THRESHOLD_BYTES = size_t(64) << 20;
+  /// Widest digit whose staging lines (RADIX_BASE * 64 bytes) stay in L2
+  static constexpr size_t MAX_WRITE_COMBINING_BASE = 2048;
+  /// Fewest elements per thread worth the cost of waking a worker
+  static constexpr size_t MIN_PARALLEL_CHUNK = size_t(1) << 14;
+  /// Bucket size below which a parallel MSD task recurses on its own
+  static constexpr size_t PARALLEL_MSD_SPLIT = size_t(1) << 15;
+
+  /*!
+   * @brief A bucket of a parallel MSD sort, with the arguments of msd_sort
+   */
+  template <typename V> struct MsdTask {
+    T *data;
+    T *scratch;
+    V *data_values;
+    V *scratch_values;
+    size_t n;
+    size_t passes;
+    bool into_scratch;
+  };
+
+  /*!
+   * @brief One cache line of staged elements for a bucket
+   */
+  struct alignas(CACHE_LINE_SIZE) StagingLine {
+    unsigned char bytes[CACHE_LINE_SIZE];
+  };
+  /// Lines of one thread's staging area: RADIX_BASE staging lines followed
+  /// by lines holding RADIX_BASE counters of staged elements
+  static constexpr size_t STAGING_LINES =
+      RADIX_BASE +
+      (RADIX_BASE * sizeof(size_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+
+  DataType data_type_;               ///< Type of data being sorted
+  ProcessingOrder processing_order_; ///< Byte processing order
+  Direction direction_;              ///< Sort direction
+  ScatterMode scatter_mode_;         ///< Scatter strategy of counting passes
+  Stability stability_;              ///< Stability guarantee of sort()
+  Execution execution_;              ///< Execution policy of sort()
+  size_t thread_count_;              ///< Parallel threads, 0 for all cores
+  std::shared_ptr<ThreadPool> thread_pool_; ///< Workers of parallel sorts
+  std::shared_ptr<SortWorkspace> workspace_; ///< Scratch memory, if shared
+  /// Resource of per-sort workspaces, null for the default resource
+  std::shared_ptr<std::pmr::memory_resource> scratch_resource_;
+  size_t memory_budget_; ///< Scratch bytes of a stable sort, 0 for no limit
+
+  // Key transform applied while digits are extracted: a native key k is
+  // ordered by k ^ key_flip_ ^ (negative_flip_ if k's top bit is set).
+  // Numeric key types only carry the negative flip for floating point,
+  // where it is a compile-time constant.
+  uint64_t key_flip_;          ///< Bits flipped in every native key
+  uint64_t negative_flip_;     ///< Extra bits flipped when the top bit is set
+  unsigned char byte_flip_;    ///< Bits flipped in every byte of byte keys
+  unsigned char msb_flip_;     ///< Extra bits flipped in their top byte
+
+  static constexpr size_t KEY_BITS = sizeof(T) * 8; ///< Bits per key
+  /// Whether the negative flip is applied, known at compile time if numeric
+  static constexpr bool RUNTIME_NEGATIVE_FLIP = !radix_key_traits<T>::is_numeric;
+  static constexpr bool NEGATIVE_FLIP =
+      radix_key_traits<T>::is_floating_point || RUNTIME_NEGATIVE_FLIP;
+  /// Negative flip of IEEE 754 keys: every bit but the sign
+  static constexpr uint64_t FLOAT_NEGATIVE_FLIP =
+      ~uint64_t(0) >> (KEY_BITS >= 64 ? 1 : 65 - KEY_BITS);
+
+  /// Whether the engines move a payload of type V alongside the keys
+  template <typename V>
+  static constexpr bool HAS_VALUES = !std::is_same<V, detail::no_values>::value;
+
+  /*!
+   * @brief Offset a payload pointer, leaving a keys-only sort's null as is
+   *
+   * @param values Payload array, null without a payload
+   * @param offset Element offset
+   * @return Pointer to values[offset]
+   */
+  template <typename V> static V *values_at(V *values, const size_t offset) {
+    if constexpr (HAS_VALUES<V>) {
+      return values + offset;
+    } else {
+      return values;
+    }
+  }
+
+  /*!
+   * @brief Memory resource of the workspace a sort creates for itself
+   */
+  std::pmr::memory_resource *scratch_resource() const {
+    return scratch_resource_ ? scratch_resource_.get()
+                             : std::pmr::get_default_resource();
+  }
+
+  /*!
+   * @brief Run a sort on the shared workspace or on one of its own
+   *
+   * @param run Callable sorting with the workspace it is passed
+   * @throw RadixException with MEMORY_ALLOCATION if memory runs out
+   */
+  template <typename Run> void with_workspace(const Run &run) {
+    try {
+      SortWorkspace local(scratch_resource());
+      run(workspace_ ? *workspace_ : local);
+    } catch (const std::bad_alloc &) {
+      throw RadixException(ErrorCode::MEMORY_ALLOCATION,
+                           "Failed to allocate scratch memory");
+    }
+  }
+
+  /*!
+   * @brief Sort the first k elements, leaving the others unordered
+   *
+   * @param array Pointer to the keys
+   * @param values Pointer to the payload, null for detail::no_values
+   * @param n Number of elements in the array
+   * @param k Number of leading elements to sort
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename V>
+  void partial_sort_elements(T *array, V *values, const size_t n, size_t k,
+                             SortWorkspace &workspace) {
+    if (array == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Array pointer is null");
+    }
+    k = std::min(k, n);
+    if (k == 0) {
+      return;
+    }
+
+    size_t survivors = n;
+    if constexpr (NATIVE_KEY) {
+      if (!is_string_sort()) {
+        SortWorkspace::Frame frame(workspace);
+        if (k <= n / HEAP_SELECT_RATIO) {
+          SortWorkspace::Array<Candidate> heap(workspace, k);
+          survivors = heap_select_first(array, values, n, k, heap.get());
+        } else {
+          SortWorkspace::Array<size_t> counts(workspace, RADIX_BASE);
+          survivors = select_first(array, values, n, k, counts.get());
+        }
+      }
+    }
+    sort_elements(array, values, survivors, stability_, workspace);
+  }
+
+  /// Key and position of an element kept by heap selection
+  struct Candidate {
+    key_type key;
+    size_t index;
+
+    bool operator<(const Candidate &other) const {
+      return key < other.key || (key == other.key && index < other.index);
+    }
+  };
+
+  /*!
+   * @brief Move the first k elements to the front with a max-heap
+   *
+   * The heap holds the k smallest (key, position) pairs seen so far, so a
+   * single read of the keys costs one comparison with the heap's top for
+   * most elements. Ties are settled by position, which keeps the first k
+   * elements of a stable sort. The chosen elements are then moved to the
+   * front in input order by k swaps.
+   *
+   * @param array Pointer to the keys
+   * @param values Payload of the keys, moved along
+   * @param n Number of elements
+   * @param k Number of elements to keep, 1 to n
+   * @param heap Buffer of k candidates
+   * @return k; array[0, k) holds the first k elements in input order
+   */
+  template <typename V>
+  size_t heap_select_first(T *array, V *values, const size_t n, const size_t k,
+                           Candidate *heap) const {
+    for (size_t i = 0; i < k; ++i) {
+      heap[i] = Candidate{sortable_key(array[i]), i};
+    }
+    std::make_heap(heap, heap + k);
+    auto offer = [&](const size_t i) {
+      const key_type key = sortable_key(array[i]);
+      if (key < heap[0].key) {
+        replace_top(heap, k, Candidate{key, i});
+      }
+    };
+    size_t i = k;
+#ifdef __AVX2__
+    if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+      i = skip_above_simd(array, i, n, heap[0].key, [&](const size_t j) {
+        offer(j);
+        return uint64_t(heap[0].key);
+      });
+    }
+#endif
+    for (; i < n; ++i) {
+      offer(i);
+    }
+
+    std::sort(heap, heap + k, [](const Candidate &a, const Candidate &b) {
+      return a.index < b.index;
+    });
+    for (size_t i = 0; i < k; ++i) {
+      keep(array, values, i, heap[i].index);
+    }
+    return k;
+  }
+
+  /*!
+   * @brief Replace the largest candidate of a max-heap and restore it
+   */
+  static void replace_top(Candidate *heap, const size_t size,
+                          const Candidate candidate) {
+    size_t hole = 0;
+    for (size_t child = 1; child < size; child = 2 * hole + 1) {
+      if (child + 1 < size && heap[child] < heap[child + 1]) {
+        ++child;
+      }
+      if (!(candidate < heap[child])) {
+        break;
+      }
+      heap[hole] = heap[child];
+      hole = child;
+    }
+    heap[hole] = candidate;
+  }
+
+  /*!
+   * @brief Gather a superset of the first k elements at the front
+   *
+   * Works out the k-th key one digit at a time, from the top. A histogram
+   * of the candidates whose higher digits match the k-th key so far
+   * locates the k-th key's bucket; candidates past it are then dropped by
+   * a compaction that keeps the others in input order, so a stable sort
+   * of them stays stable. The compaction also counts the next digit of
+   * the candidates it keeps, so every digit after the first reads the
+   * candidates once. Stops once few candidates are left, or after the
+   * last digit, when only ties of the k-th key beyond the first k
+   * elements are left to drop.
+   *
+   * @param array Pointer to the keys
+   * @param values Payload of the keys, moved along
+   * @param n Number of elements
+   * @param k Number of elements to keep, 1 to n
+   * @param counts Buffer of RADIX_BASE counters
+   * @return Number m of candidates; array[0, m) holds the first k
+   *         elements in input order
+   */
+  template <typename V>
+  size_t select_first(T *array, V *values, const size_t n, const size_t k,
+                      size_t *counts) const {
+    if (n <= 2 * k + MSD_SMALL_SORT_THRESHOLD) {
+      return n; // Sorting everything is cheaper than narrowing
+    }
+    size_t pass = PASS_COUNT - 1;
+    std::fill(counts, counts + RADIX_BASE, size_t(0));
+    for (size_t i = 0; i < n; ++i) {
+      ++counts[(uint64_t(sortable_key(array[i])) >> (pass * RadixBits)) &
+               RADIX_MASK];
+    }
+
+    size_t m = n;
+    size_t below = 0;    // Candidates below the prefix, all kept
+    uint64_t prefix = 0; // Digits of the k-th key found so far
+    for (;; --pass) {
+      size_t bucket = 0;
+      for (size_t seen = below; seen + counts[bucket] < k; ++bucket) {
+        seen += counts[bucket];
+      }
+      prefix = (prefix << RadixBits) | bucket;
+
+      // Keep the candidates up to the prefix and count the next digit of
+      // those that match it
+      const size_t shift = pass * RadixBits;
+      const size_t next_shift = pass > 0 ? shift - RadixBits : 0;
+      std::fill(counts, counts + RADIX_BASE, size_t(0));
+      below = 0;
+      size_t kept = 0;
+      for (size_t i = 0; i < m; ++i) {
+        const uint64_t key = sortable_key(array[i]);
+        const uint64_t high = key >> shift;
+        if (high <= prefix) {
+          if (high < prefix) {
+            ++below;
+          } else {
+            ++counts[(key >> next_shift) & RADIX_MASK];
+          }
+          keep(array, values, kept++, i);
+        }
+      }
+      m = kept;
+      if (pass == 0 || m <= 2 * k + MSD_SMALL_SORT_THRESHOLD) {
+        break;
+      }
+    }
+    if (pass > 0) {
+      return m; // Sorting the candidates is cheaper than narrowing
+    }
+
+    // prefix is now the k-th key: keep the ties that come first
+    size_t ties = k - below;
+    size_t kept = 0;
+    for (size_t i = 0; i < m; ++i) {
+      const uint64_t key = sortable_key(array[i]);
+      if (key < prefix || (key == prefix && ties > 0)) {
+        ties -= key == prefix;
+        keep(array, values, kept++, i);
+      }
+    }
+    return kept;
+  }
+
+  /*!
+   * @brief Find the elements of several ranks
+   *
+   * @param array Pointer to the array, left unchanged
+   * @param n Number of elements in the array
+   * @param count Number of ranks
+   * @param rank_of Callable returning rank i, below n; ranks come in any
+   *                order
+   * @param selected Element of each rank, in the order of the ranks, on
+   *                 return
+   */
+  template <typename RankOf>
+  void select_ranks(const T *array, const size_t n, const size_t count,
+                    const RankOf &rank_of, T *selected) {
+    if (count == 0) {
+      return;
+    }
+    if (array == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Array pointer is null");
+    }
+    with_workspace([&](SortWorkspace &workspace) {
+      SortWorkspace::Frame frame(workspace);
+      SortWorkspace::Array<size_t> unique(workspace, count);
+      for (size_t i = 0; i < count; ++i) {
+        unique[i] = rank_of(i);
+      }
+      std::sort(unique.get(), unique.get() + count);
+      const size_t ranks =
+          std::unique(unique.get(), unique.get() + count) - unique.get();
+
+      SortWorkspace::Array<T> found(workspace, ranks);
+      bool narrowed = false;
+      if constexpr (NATIVE_KEY) {
+        // Histograms of every rank must not outgrow the array
+        if (!is_string_sort() && ranks * RADIX_BASE <= n) {
+          narrow_ranks(array, n, unique.get(), ranks, found.get(),
+                       workspace);
+          narrowed = true;
+        }
+      }
+      if (!narrowed) {
+        // Small arrays and keys without digits to narrow: sort a copy
+        SortWorkspace::Array<T> sorted(workspace, n);
+        std::copy(array, array + n, sorted.get());
+        sort_elements(sorted.get(), static_cast<detail::no_values *>(nullptr),
+                      n, stability_, workspace);
+        for (size_t i = 0; i < ranks; ++i) {
+          found[i] = sorted[unique[i]];
+        }
+      }
+
+      for (size_t i = 0; i < count; ++i) {
+        selected[i] = found[std::lower_bound(unique.get(),
+                                             unique.get() + ranks,
+                                             rank_of(i)) -
+                            unique.get()];
+      }
+    });
+  }
+
+  /*!
+   * @brief Narrow down the keys of sorted ranks digit by digit
+   *
+   * Every rank tracks the digits of its key found so far (its prefix) and
+   * the number of elements with smaller prefixes. Ranks sharing a prefix
+   * form a group with one histogram. Each digit reads the candidates
+   * once: an element whose higher digits match a group's prefix counts
+   * towards that group's histogram, and each rank then picks the bucket
+   * holding it. Elements of no group count towards a discard histogram,
+   * which keeps the loop free of branches. Candidates are gathered into
+   * a buffer once they are an eighth of those read, and filtered in place
+   * from then on, so the array is read but never written and only few
+   * elements are copied.
+   *
+   * @param array Pointer to the array
+   * @param n Number of elements in the array
+   * @param ranks Strictly increasing ranks, each below n
+   * @param count Number of ranks
+   * @param found Element of each rank, on return
+   * @param workspace Scratch memory of the histograms and candidates
+   */
+  void narrow_ranks(const T *array, const size_t n, const size_t *ranks,
+                    const size_t count, T *found,
+                    SortWorkspace &workspace) const {
+    SortWorkspace::Frame frame(workspace);
+    SortWorkspace::Array<size_t> counts(workspace, count * RADIX_BASE);
+    SortWorkspace::Array<size_t> lanes(
+        workspace, (count + 1) * RADIX_BASE * HISTOGRAM_LANES);
+    SortWorkspace::Array<uint64_t> prefixes(workspace, count);
+    SortWorkspace::Array<size_t> starts(workspace, count);
+    SortWorkspace::Array<size_t> sizes(workspace, count);
+    // Groups of ranks with equal prefixes, in increasing order
+    SortWorkspace::Array<uint64_t> group_prefixes(workspace, count);
+    SortWorkspace::Array<size_t> group_firsts(workspace, count + 1);
+    std::optional<SortWorkspace::Array<T>> gathered;
+
+    size_t groups = 1;
+    group_prefixes[0] = 0;
+    group_firsts[0] = 0;
+    group_firsts[1] = count;
+    for (size_t j = 0; j < count; ++j) {
+      prefixes[j] = 0;
+      starts[j] = 0;
+      sizes[j] = n;
+    }
+
+    const T *source = array;
+    size_t m = n;          // Elements read by the next digit
+    size_t candidates = n; // Elements matching a group's prefix
+
+    for (size_t pass = PASS_COUNT; pass-- > 0;) {
+      const size_t shift = pass * RadixBits;
+      const size_t buckets = (groups + 1) * RADIX_BASE;
+      std::fill(lanes.get(), lanes.get() + buckets * HISTOGRAM_LANES,
+                size_t(0));
+
+      T *target = nullptr;
+      if (gathered) {
+        target = gathered->get(); // Filter the buffer in place
+      } else if (candidates <= m / 8) {
+        // One spare slot takes the unconditional store of a discarded element
+        gathered.emplace(workspace, candidates + 1);
+        target = gathered->get();
+      }
+      const size_t kept =
+          target != nullptr
+              ? count_candidates<true>(source, m, shift, group_prefixes.get(),
+                                       groups, lanes.get(), target)
+              : count_candidates<false>(source, m, shift, group_prefixes.get(),
+                                        groups, lanes.get(), target);
+      for (size_t bucket = 0; bucket < groups * RADIX_BASE; ++bucket) {
+        counts[bucket] = 0;
+        for (size_t lane = 0; lane < HISTOGRAM_LANES; ++lane) {
+          counts[bucket] += lanes[bucket * HISTOGRAM_LANES + lane];
+        }
+      }
+      if (target != nullptr) {
+        source = target;
+        m = kept;
+      }
+
+      // Each rank moves into the bucket holding it
+      for (size_t group = 0; group < groups; ++group) {
+        const size_t *histogram = counts.get() + group * RADIX_BASE;
+        size_t start = starts[group_firsts[group]];
+        size_t bucket = 0;
+        for (size_t j = group_firsts[group]; j < group_firsts[group + 1]; ++j) {
+          while (start + histogram[bucket] <= ranks[j]) {
+            start += histogram[bucket++];
+          }
+          prefixes[j] = (group_prefixes[group] << RadixBits) | bucket;
+          starts[j] = start;
+          sizes[j] = histogram[bucket];
+        }
+      }
+      groups = 0;
+      candidates = 0;
+      for (size_t j = 0; j < count; ++j) {
+        if (j == 0 || prefixes[j] != prefixes[j - 1]) {
+          group_prefixes[groups] = prefixes[j];
+          group_firsts[groups++] = j;
+          candidates += sizes[j];
+        }
+      }
+      group_firsts[groups] = count;
+    }
+
+    // The prefixes are now whole keys; equal keys are equal elements
+    size_t missing = groups;
+    for (size_t i = 0; i < m && missing > 0; ++i) {
+      const size_t group =
+          group_of(sortable_key(source[i]), group_prefixes.get(), groups);
+      if (group < groups && sizes[group_firsts[group]] > 0) {
+        for (size_t j = group_firsts[group]; j < group_firsts[group + 1]; ++j) {
+          found[j] = source[i];
+        }
+        sizes[group_firsts[group]] = 0;
+        --missing;
+      }
+    }
+  }
+
+  /*!
+   * @brief Histogram one digit of the candidates of every group
+   *
+   * @tparam GATHER Whether to copy the candidates to target
+   * @param source Elements to read
+   * @param m Number of elements to read
+   * @param shift Bit offset of the digit
+   * @param prefixes Increasing prefixes of the groups
+   * @param groups Number of groups
+   * @param lanes Interleaved sub-histograms of the groups and of the
+   *              discarded elements, zeroed
+   * @param target Buffer of the candidates, with a spare slot; may be
+   *               source itself
+   * @return Number of candidates copied to target
+   */
+  template <bool GATHER>
+  size_t count_candidates(const T *source, const size_t m, const size_t shift,
+                          const uint64_t *prefixes, const size_t groups,
+                          size_t *lanes, T *target) const {
+    const size_t high_shift = shift + RadixBits;
+    size_t kept = 0;
+    auto count_key = [&](const T &element, const size_t lane) {
+      const uint64_t key = sortable_key(element);
+      const uint64_t high = high_shift >= KEY_BITS ? 0 : key >> high_shift;
+      const size_t group = groups == 1 ? size_t(high != prefixes[0])
+                                       : group_of(high, prefixes, groups);
+      const size_t digit = (key >> shift) & RADIX_MASK;
+      ++lanes[(group * RADIX_BASE + digit) * HISTOGRAM_LANES + lane];
+      if constexpr (GATHER) {
+        target[kept] = element;
+        kept += group < groups;
+      }
+    };
+    size_t i = 0;
+    for (; i + HISTOGRAM_LANES <= m; i += HISTOGRAM_LANES) {
+      for (size_t lane = 0; lane < HISTOGRAM_LANES; ++lane) {
+        count_key(source[i + lane], lane);
+      }
+    }
+    for (; i < m; ++i) {
+      count_key(source[i], 0);
+    }
+    return kept;
+  }
+
+  /*!
+   * @brief Index of the group with a given prefix
+   *
+   * @param high Prefix to look up
+   * @param prefixes Increasing prefixes of the groups
+   * @param groups Number of groups
+   * @return Index of the group, or groups if no group has the prefix
+   */
+  static size_t group_of(const uint64_t high, const uint64_t *prefixes,
+                         const size_t groups) {
+    size_t group = 0;
+    if (groups <= 8) {
+      for (size_t g = 0; g < groups; ++g) {
+        group += prefixes[g] < high;
+      }
+    } else {
+      group = std::lower_bound(prefixes, prefixes + groups, high) - prefixes;
+    }
+    return group < groups && prefixes[group] == high ? group : groups;
+  }
+
+  /*!
+   * @brief Move element from to slot to of a compaction
+   *
+   * Slots between to and from hold dropped elements, so swapping keeps
+   * every element while the kept ones stay in order.
+   */
+  template <typename V>
+  static void keep(T *array, V *values, const size_t to, const size_t from) {
+    if (to != from) {
+      std::swap(array[to], array[from]);
+      if constexpr (HAS_VALUES<V>) {
+        std::swap(values[to], values[from]);
+      }
+    }
+  }
+
+  /*!
+   * @brief Fill perm with the stable sorting permutation of keys
+   *
+   * @param keys Pointer to the keys to be ranked
+   * @param n Number of keys
+   * @param perm Output array of n indices
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename Index>
+  void argsort_indices(const T *keys, const size_t n, Index *perm,
+                       SortWorkspace &workspace) {
+    if (keys == nullptr || perm == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Array pointer is null");
+    }
+
+    SortWorkspace::Frame frame(workspace);
+    SortWorkspace::Array<T> copy(workspace, n);
+    std::memcpy(copy.get(), keys, n * sizeof(T));
+    for (size_t i = 0; i < n; ++i) {
+      perm[i] = static_cast<Index>(i);
+    }
+    sort_elements(copy.get(), perm, n, Stability::STABLE, workspace);
+  }
+
+  /*!
+   * @brief Sort keys and, if V is a payload type, their values
+   *
+   * @param array Pointer to the keys to be sorted
+   * @param values Pointer to the payload, null for detail::no_values
+   * @param n Number of elements in the array
+   * @param stability Stability guarantee of this sort
+   * @param workspace Scratch memory of the sort
+   * @throw RadixException if sorting fails
+   */
+  template <typename V>
+  void sort_elements(T *array, V *values, const size_t n,
+                     const Stability stability, SortWorkspace &workspace) {
+    if (array == nullptr) {
+      throw RadixException(ErrorCode::NULL_POINTER, "Array pointer is null");
+    }
+
+    if (n <= 1) {
+      return; // Nothing to sort
+    }
+    if constexpr (NATIVE_KEY) {
+      if (!is_string_sort() &&
+          sort_presorted(array, values, n, stability, workspace)) {
+        return;
+      }
+    }
+
+    // Sorts that need an O(n) scratch buffer are bounded by the budget
+    const bool in_place = stability == Stability::UNSTABLE && !is_string_sort();
+    const size_t budget = budget_elements<V>();
+    if (!in_place && n > budget) {
+      merge_sort_runs(array, values, n, budget, workspace);
+      return;
+    }
+
+    // Every buffer is borrowed before the first element moves, so if one
+    // cannot be allocated the input is intact and can be sorted in halves
+    try {
+      sort_with_scratch(array, values, n, stability, workspace);
+    } catch (const std::bad_alloc &) {
+      if (in_place || n <= MSD_SMALL_SORT_THRESHOLD) {
+        throw;
+      }
+      merge_sort_runs(array, values, n,
+                      std::max(n / 2, MSD_SMALL_SORT_THRESHOLD), workspace);
+    }
+  }
+
+  /*!
+   * @brief Finish presorted input without radix passes
+   *
+   * Scans neighbouring keys in blocks, counting ascents and descents with
+   * branch-free vector compares. Input without descents is
+   * already sorted. Input without ascents is sorted in reverse and is
+   * reversed in place; a stable sort then restores the order of ties.
+   * Stable sorts merge input of at most MAX_NATURAL_RUNS ascending runs;
+   * unstable sorts, which promise no O(n) scratch buffer, do not, and
+   * neither do sorts that would run on several threads, as the merges
+   * run on the calling thread only. The scan
+   * gives up at the end of the first block where neither case is
+   * possible, so random input pays for a block or two.
+   *
+   * @param array Pointer to the keys, at least two
+   * @param values Payload of the elements, moved along
+   * @param n Number of elements
+   * @param stability Stability guarantee of this sort
+   * @param workspace Scratch memory of the merges
+   * @return false, with the input untouched, if it is not presorted
+   */
+  template <typename V>
+  bool sort_presorted(T *array, V *values, const size_t n,
+                      const Stability stability, SortWorkspace &workspace) {
+    size_t bounds[MAX_NATURAL_RUNS + 1] = {0};
+    size_t runs = 1;
+    size_t ascents = 0;
+    size_t descents = 0;
+    for (size_t begin = 0; begin + 1 < n; begin += PRESORTED_SCAN_BLOCK) {
+      const size_t end = std::min(begin + PRESORTED_SCAN_BLOCK, n - 1);
+      size_t block_ascents = 0;
+      size_t block_descents = 0;
+      size_t i = begin;
+#ifdef __AVX2__
+      if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+        i = count_order_simd(array, begin, end, block_ascents,
+                             block_descents);
+      }
+#endif
+      for (; i < end; ++i) {
+        const key_type current = sortable_key(array[i]);
+        const key_type next = sortable_key(array[i + 1]);
+        block_ascents += current < next;
+        block_descents += current > next;
+      }
+      ascents += block_ascents;
+      descents += block_descents;
+      if (descents >= MAX_NATURAL_RUNS && ascents > 0) {
+        return false; // Neither a few runs nor reversed
+      }
+      // Record where the runs of this block start
+      for (size_t i = begin; block_descents > 0 && descents < MAX_NATURAL_RUNS;
+           ++i) {
+        if (sortable_key(array[i + 1]) < sortable_key(array[i])) {
+          bounds[runs++] = i + 1;
+          --block_descents;
+        }
+      }
+    }
+
+    if (descents == 0) {
+      return true; // Already sorted
+    }
+    if (ascents == 0) {
+      reverse_elements(array, values, n);
+      if (stability == Stability::STABLE && ascents + descents < n - 1) {
+        // Reversing turned every block of ties around
+        for (size_t begin = 0; begin < n;) {
+          size_t end = begin + 1;
+          while (end < n &&
+                 sortable_key(array[end]) == sortable_key(array[begin])) {
+            ++end;
+          }
+          reverse_elements(array + begin, values_at(values, begin),
+                           end - begin);
+          begin = end;
+        }
+      }
+      return true;
+    }
+    if (descents >= MAX_NATURAL_RUNS || stability == Stability::UNSTABLE ||
+        worker_count(n) > 1) {
+      return false;
+    }
+
+    bounds[runs] = n;
+    with_merge_buffer<V>(
+        std::min(n / 2, budget_elements<V>()), workspace,
+        [&](T *buffer, V *buffer_values, const size_t capacity) {
+          for (; runs > 1; runs = (runs + 1) / 2) {
+            for (size_t run = 0; run < runs; run += 2) {
+              const size_t begin = bounds[run];
+              if (run + 1 < runs) {
+                merge_adjacent(array + begin, values_at(values, begin),
+                               bounds[run + 1] - begin,
+                               bounds[run + 2] - begin, buffer, buffer_values,
+                               capacity);
+              }
+              bounds[run / 2] = begin;
+            }
+            bounds[(runs + 1) / 2] = n;
+          }
+        });
+    return true;
+  }
+
+  /*!
+   * @brief Reverse the order of elements and their payload
+   */
+  template <typename V>
+  static void reverse_elements(T *array, V *values, const size_t n) {
+    std::reverse(array, array + n);
+    if constexpr (HAS_VALUES<V>) {
+      std::reverse(values, values + n);
+    }
+  }
+
+  /*!
+   * @brief Radix sort with scratch buffers borrowed for the whole array
+   *
+   * @param array Pointer to the keys to be sorted, at least two
+   * @param values Pointer to the payload, null for detail::no_values
+   * @param n Number of elements in the array
+   * @param stability Stability guarantee of this sort
+   * @param workspace Scratch memory of the sort
+   * @throw std::bad_alloc, before any element moves, if memory runs out
+   */
+  template <typename V>
+  void sort_with_scratch(T *array, V *values, const size_t n,
+                         const Stability stability, SortWorkspace &workspace) {
+    SortWorkspace::Frame frame(workspace);
+
+    // Special handling for string sorting
+    if (is_string_sort()) {
+      radix_sort_strings(reinterpret_cast<char *>(array), values, n,
+                         sizeof(T), workspace);
+      return;
+    }
+
+    const size_t threads = worker_count(n);
+
+    // Build the histograms of every digit in a single read of the array
+    SortWorkspace::Array<size_t> histograms(workspace,
+                                            PASS_COUNT * RADIX_BASE);
+    build_histograms(array, n, histograms.get(), threads, workspace);
+
+    // In-place: permute bucket by bucket without a scratch buffer
+    if (stability == Stability::UNSTABLE) {
+      const size_t passes = significant_passes(array, n, histograms.get());
+      if (passes > 0) {
+        SortWorkspace::Array<size_t> heads(workspace, PASS_COUNT * RADIX_BASE);
+        inplace_msd_partition(array, values, passes, histograms.get(),
+                              heads.get());
+      }
+      return;
+    }
+
+    // Borrow the scratch buffers for counting sort
+    SortWorkspace::Array<T> temp_array(workspace, n);
+    SortWorkspace::Array<V> temp_values(workspace, HAS_VALUES<V> ? n : 0);
+
+    // One staging area per thread if the scatter is write-combined
+    StagingLine *staging = nullptr;
+    if (use_write_combining(n)) {
+      staging = static_cast<StagingLine *>(workspace.allocate(
+          threads * STAGING_LINES * sizeof(StagingLine), CACHE_LINE_SIZE));
+    }
+
+    // MSB-first: partition on the top digit and recurse into the buckets
+    if (processing_order_ == ProcessingOrder::MSB_FIRST) {
+      const size_t passes = significant_passes(array, n, histograms.get());
+      if (passes > 0 && threads > 1) {
+        parallel_msd_sort(array, temp_array.get(), values, temp_values.get(),
+                          n, passes, histograms.get(), threads, staging,
+                          workspace);
+      } else if (passes > 0) {
+        // The top digit's histogram seeds the first partition, and the
+        // remaining slices serve as per-level counters of the recursion
+        msd_partition(array, temp_array.get(), values, temp_values.get(), n,
+                      passes, false, histograms.get(), staging);
+      }
+      return;
+    }
+
+    if (threads > 1) {
+      parallel_lsd_sort(array, temp_array.get(), values, temp_values.get(), n,
+                        histograms.get(), threads, staging, workspace);
+      return;
+    }
+
+    // Each pass scatters from source to destination, then the two buffers
+    // swap roles so no pass has to copy its output back
+    T *source = array;
+    T *destination = temp_array.get();
+    V *source_values = values;
+    V *destination_values = temp_values.get();
+
+    // Main sorting loop, LSB-first (right to left)
+    for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+      if (is_trivial_pass(source, n, pass, &histograms[pass * RADIX_BASE])) {
+        continue; // Every element shares this digit, order is unchanged
+      }
+      counting_sort_digit(source, destination, source_values,
+                          destination_values, n, pass,
+                          &histograms[pass * RADIX_BASE], staging);
+      std::swap(source, destination);
+      std::swap(source_values, destination_values);
+    }
+
+    // After an odd number of passes the result lives in the scratch buffer
+    if (source != array) {
+      std::memcpy(array, source, n * sizeof(T));
+      if constexpr (HAS_VALUES<V>) {
+        std::move(source_values, source_values + n, values);
+      }
+    }
+  }
+
+  /*!
+   * @brief Derive the key transform masks from the data type
+   *
+   * Sign and IEEE 754 handling is folded into digit extraction instead of
+   * rewriting the array before and after sorting:
+   * - signed integers flip the sign bit, moving negatives below positives
+   * - floats flip the sign bit of positives and every bit of negatives,
+   *   which turns sign-magnitude into an ordered unsigned key
+   * - descending order complements the whole key, so the engines always
+   *   sort ascending and stay stable for equal keys
+   */
+  void init_key_transform() {
+    key_flip_ = 0;
+    negative_flip_ = 0;
+    byte_flip_ = 0;
+    msb_flip_ = 0;
+
+    if constexpr (NATIVE_KEY) {
+      const uint64_t key_mask = ~uint64_t(0) >> (64 - KEY_BITS);
+      const uint64_t sign_bit = uint64_t(1) << (KEY_BITS - 1);
+      switch (data_type_) {
+      case DataType::SIGNED_INTEGER:
+        key_flip_ = sign_bit;
+        break;
+      case DataType::IEEE754_FLOAT:
+      case DataType::IEEE754_DOUBLE:
+        key_flip_ = sign_bit;
+        negative_flip_ = key_mask & ~sign_bit;
+        break;
+      default:
+        break;
+      }
+      if (direction_ == Direction::DESCENDING) {
+        key_flip_ ^= key_mask;
+      }
+    } else {
+      if (data_type_ == DataType::SIGNED_INTEGER) {
+        msb_flip_ = 0x80;
+      }
+      if (direction_ == Direction::DESCENDING) {
+        byte_flip_ = 0xFF;
+      }
+    }
+  }
+
+  /*!
+   * @brief Load a native key and apply the key transform
+   *
+   * @param element Element to read
+   * @return Unsigned key whose natural order is the sort order
+   */
+  key_type sortable_key(const T &element) const {
+    key_type key;
+    std::memcpy(&key, &element, sizeof(T));
+    if constexpr (NEGATIVE_FLIP) {
+      const key_type negative = static_cast<key_type>(
+          key_type(0) - static_cast<key_type>(key >> (KEY_BITS - 1)));
+      const key_type negative_flip =
+          static_cast<key_type>(RUNTIME_NEGATIVE_FLIP ? negative_flip_
+                                                      : FLOAT_NEGATIVE_FLIP);
+      key ^= static_cast<key_type>(negative & negative_flip);
+    }
+    return static_cast<key_type>(key ^ static_cast<key_type>(key_flip_));
+  }
+
+  /*!
+   * @brief Extract one digit of an element
+   *
+   * @param element Element to read the digit from
+   * @param pass Digit index, 0 being the least significant
+   * @return Digit value in [0, RADIX_BASE)
+   */
+  size_t digit_at(const T &element, const size_t pass) const {
+    if constexpr (NATIVE_KEY) {
+      return static_cast<size_t>(sortable_key(element) >> (pass * RadixBits)) &
+             RADIX_MASK;
+    } else {
+      const unsigned char byte =
+          reinterpret_cast<const unsigned char *>(&element)[pass];
+      return pass == sizeof(T) - 1 ? byte ^ byte_flip_ ^ msb_flip_
+                                   : byte ^ byte_flip_;
+    }
+  }
+
+  /*!
+   * @brief Build the histograms of all digit positions in one pass
+   *
+   * Reading every digit of an element while it is in cache replaces the
+   * PASS_COUNT separate counting passes over the whole array. Consecutive
+   * elements are counted into HISTOGRAM_LANES interleaved sub-histograms,
+   * so runs of equal digits do not serialize on a single counter's
+   * store-to-load forwarding.
+   *
+   * @param array Pointer to the array to be counted
+   * @param n Number of elements
+   * @param histograms Output table of PASS_COUNT * RADIX_BASE counters, where
+   *                   digit p owns entries [p * RADIX_BASE, +RADIX_BASE)
+   * @param threads Number of threads counting disjoint blocks
+   * @param workspace Scratch memory of the sort
+   */
+  void build_histograms(const T *array, const size_t n, size_t *histograms,
+                        const size_t threads, SortWorkspace &workspace) {
+    constexpr size_t BUCKETS = PASS_COUNT * RADIX_BASE;
+    SortWorkspace::Array<uint32_t> lanes(workspace,
+                                         threads * BUCKETS * HISTOGRAM_LANES);
+    if (threads == 1) {
+      count_histograms(array, n, histograms, lanes.get());
+      return;
+    }
+
+    // Every thread counts its block into a private table, then the tables
+    // are summed
+    SortWorkspace::Array<size_t> tables(workspace, threads * BUCKETS);
+    run_parallel(threads, [&](const size_t thread) {
+      const size_t begin = block_begin(n, threads, thread);
+      count_histograms(array + begin,
+                       block_begin(n, threads, thread + 1) - begin,
+                       &tables[thread * BUCKETS],
+                       &lanes[thread * BUCKETS * HISTOGRAM_LANES]);
+    });
+    std::copy(tables.get(), tables.get() + BUCKETS, histograms);
+    for (size_t thread = 1; thread < threads; ++thread) {
+      for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        histograms[bucket] += tables[thread * BUCKETS + bucket];
+      }
+    }
+  }
+
+  /*!
+   * @brief Count the digits of a block into its histograms
+   *
+   * @param array Pointer to the block
+   * @param n Number of elements
+   * @param histograms Output table of PASS_COUNT * RADIX_BASE counters
+   * @param lanes Sub-histogram counters, HISTOGRAM_LANES per counter
+   */
+  void count_histograms(const T *array, const size_t n, size_t *histograms,
+                        uint32_t *lanes) {
+    constexpr size_t BUCKETS = PASS_COUNT * RADIX_BASE;
+    std::fill(histograms, histograms + BUCKETS, size_t(0));
+
+    for (size_t begin = 0; begin < n; begin += HISTOGRAM_CHUNK) {
+      const size_t chunk = std::min(HISTOGRAM_CHUNK, n - begin);
+      std::fill(lanes, lanes + BUCKETS * HISTOGRAM_LANES, uint32_t(0));
+      count_digits(array + begin, chunk, lanes);
+
+      // Fold the sub-histograms into the final counts
+      for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        for (size_t lane = 0; lane < HISTOGRAM_LANES; ++lane) {
+          histograms[bucket] += lanes[bucket * HISTOGRAM_LANES + lane];
+        }
+      }
+    }
+  }
+
+  /*!
+   * @brief Count the digits of a chunk into interleaved sub-histograms
+   *
+   * @param array Pointer to the chunk to be counted
+   * @param n Number of elements, at most HISTOGRAM_CHUNK
+   * @param lanes Counters where bucket b of lane l lives at
+   *              b * HISTOGRAM_LANES + l
+   */
+  void count_digits(const T *array, const size_t n, uint32_t *lanes) {
+    size_t i = 0;
+
+    if constexpr (NATIVE_KEY) {
+#ifdef __AVX2__
+      if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+        i = count_digits_simd(array, n, lanes);
+      }
+#endif
+      auto count_key = [this, lanes](const T &element, const size_t lane) {
+        const key_type key = sortable_key(element);
+        for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+          size_t digit =
+              static_cast<size_t>(key >> (pass * RadixBits)) & RADIX_MASK;
+          lanes[(pass * RADIX_BASE + digit) * HISTOGRAM_LANES + lane]++;
+        }
+      };
+      for (; i + HISTOGRAM_LANES <= n; i += HISTOGRAM_LANES) {
+        for (size_t lane = 0; lane < HISTOGRAM_LANES; ++lane) {
+          count_key(array[i + lane], lane);
+        }
+      }
+      for (; i < n; ++i) {
+        count_key(array[i], 0);
+      }
+    } else {
+      const unsigned char *bytes =
+          reinterpret_cast<const unsigned char *>(array);
+      for (; i < n; ++i) {
+        const unsigned char *element = &bytes[i * sizeof(T)];
+        const size_t lane = i % HISTOGRAM_LANES;
+        for (size_t pass = 0; pass + 1 < PASS_COUNT; ++pass) {
+          lanes[(pass * RADIX_BASE + (element[pass] ^ byte_flip_)) *
+                    HISTOGRAM_LANES +
+                lane]++;
+        }
+        const size_t top = PASS_COUNT - 1;
+        lanes[(top * RADIX_BASE + (element[top] ^ byte_flip_ ^ msb_flip_)) *
+                  HISTOGRAM_LANES +
+              lane]++;
+      }
+    }
+  }
+
+#ifdef __AVX2__
+  /*!
+   * @brief Vectorized digit extraction for 32-bit and 64-bit keys
+   *
+   * Loads a full AVX2 vector of keys and derives every digit's counter
+   * index ((pass * RADIX_BASE + digit) * HISTOGRAM_LANES + lane) with
+   * vector shifts and masks; only the increments themselves stay scalar.
+   *
+   * @param array Pointer to the chunk to be counted
+   * @param n Number of elements
+   * @param lanes Interleaved sub-histogram counters
+   * @return Number of leading elements counted, a multiple of the width
+   */
+  size_t count_digits_simd(const T *array, const size_t n, uint32_t *lanes) {
+    constexpr size_t WIDTH = sizeof(__m256i) / sizeof(T);
+    constexpr int LANE_SHIFT =
+        HISTOGRAM_LANES == 4 ? 2 : (HISTOGRAM_LANES == 2 ? 1 : 0);
+
+    alignas(32) key_type index[WIDTH];
+    for (size_t j = 0; j < WIDTH; ++j) {
+      index[j] = static_cast<key_type>(j % HISTOGRAM_LANES);
+    }
+    const __m256i lane_ids =
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(index));
+    const __m128i lane_shift = _mm_cvtsi32_si128(LANE_SHIFT);
+    const __m256i key_flip = broadcast_key(key_flip_);
+    const __m256i negative_flip = broadcast_key(
+        RUNTIME_NEGATIVE_FLIP ? negative_flip_ : FLOAT_NEGATIVE_FLIP);
+
+    size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+      const __m256i keys = sortable_keys(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&array[i])),
+          key_flip, negative_flip);
+      for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+        const __m128i shift =
+            _mm_cvtsi32_si128(static_cast<int>(pass * RadixBits));
+        __m256i counter;
+        if constexpr (sizeof(T) == 4) {
+          counter = _mm256_and_si256(_mm256_srl_epi32(keys, shift),
+                                     _mm256_set1_epi32(RADIX_MASK));
+          counter = _mm256_add_epi32(
+              counter, _mm256_set1_epi32(static_cast<int>(pass * RADIX_BASE)));
+          counter = _mm256_sll_epi32(counter, lane_shift);
+        } else {
+          counter = _mm256_and_si256(_mm256_srl_epi64(keys, shift),
+                                     _mm256_set1_epi64x(RADIX_MASK));
+          counter = _mm256_add_epi64(
+              counter,
+              _mm256_set1_epi64x(static_cast<long long>(pass * RADIX_BASE)));
+          counter = _mm256_sll_epi64(counter, lane_shift);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i *>(index),
+                           _mm256_or_si256(counter, lane_ids));
+        // Spelled out so the increments do not wait on index reloads
+        lanes[index[0]]++;
+        lanes[index[1]]++;
+        lanes[index[2]]++;
+        lanes[index[3]]++;
+        if constexpr (WIDTH == 8) {
+          lanes[index[4]]++;
+          lanes[index[5]]++;
+          lanes[index[6]]++;
+          lanes[index[7]]++;
+        }
+      }
+    }
+    return i;
+  }
+
+  /*!
+   * @brief Vectorized count of ascents and descents between neighbours
+   *
+   * Compares a vector of keys with the same vector shifted by one element.
+   * The keys are flipped to signed order on top of the key transform, as
+   * AVX2 only compares signed integers.
+   *
+   * @param array Pointer to the keys
+   * @param begin First element compared with its successor
+   * @param end End of the compared elements, below the array's size
+   * @param ascents Incremented by the elements below their successor
+   * @param descents Incremented by the elements above their successor
+   * @return Index where the scalar loop continues
+   */
+  size_t count_order_simd(const T *array, const size_t begin, const size_t end,
+                          size_t &ascents, size_t &descents) const {
+    constexpr size_t WIDTH = sizeof(__m256i) / sizeof(T);
+    constexpr uint64_t SIGN = uint64_t(1) << (KEY_BITS - 1);
+    const __m256i key_flip = broadcast_key(key_flip_ ^ SIGN);
+    const __m256i negative_flip = broadcast_key(
+        RUNTIME_NEGATIVE_FLIP ? negative_flip_ : FLOAT_NEGATIVE_FLIP);
+
+    // Compare results are -1 per lane, so subtracting them counts
+    __m256i up = _mm256_setzero_si256();
+    __m256i down = _mm256_setzero_si256();
+    size_t i = begin;
+    for (; i + WIDTH <= end; i += WIDTH) {
+      const __m256i current = sortable_keys(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&array[i])),
+          key_flip, negative_flip);
+      const __m256i next = sortable_keys(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&array[i + 1])),
+          key_flip, negative_flip);
+      if constexpr (sizeof(T) == 4) {
+        up = _mm256_sub_epi32(up, _mm256_cmpgt_epi32(next, current));
+        down = _mm256_sub_epi32(down, _mm256_cmpgt_epi32(current, next));
+      } else {
+        up = _mm256_sub_epi64(up, _mm256_cmpgt_epi64(next, current));
+        down = _mm256_sub_epi64(down, _mm256_cmpgt_epi64(current, next));
+      }
+    }
+
+    alignas(32) key_type counts[2][WIDTH];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(counts[0]), up);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(counts[1]), down);
+    for (size_t j = 0; j < WIDTH; ++j) {
+      ascents += counts[0][j];
+      descents += counts[1][j];
+    }
+    return i;
+  }
+
+  /*!
+   * @brief Visit the elements whose key lies below a falling bound
+   *
+   * Compares two vectors of keys with the bound at a time and visits
+   * their elements one by one only if one of them is below it, so a scan
+   * that rarely finds a smaller key mostly runs vector compares.
+   *
+   * @param array Pointer to the keys
+   * @param begin First element to scan
+   * @param n End of the elements to scan
+   * @param bound Keys at or above the bound are skipped
+   * @param visit Called with the index of every element of a visited
+   *              group; returns the new bound
+   * @return Index where the scalar loop continues
+   */
+  template <typename Visit>
+  size_t skip_above_simd(const T *array, const size_t begin, const size_t n,
+                         uint64_t bound, const Visit &visit) const {
+    constexpr size_t WIDTH = sizeof(__m256i) / sizeof(T);
+    constexpr uint64_t SIGN = uint64_t(1) << (KEY_BITS - 1);
+    const __m256i key_flip = broadcast_key(key_flip_ ^ SIGN);
+    const __m256i negative_flip = broadcast_key(
+        RUNTIME_NEGATIVE_FLIP ? negative_flip_ : FLOAT_NEGATIVE_FLIP);
+    __m256i limit = broadcast_key(bound ^ SIGN);
+
+    size_t i = begin;
+    for (; i + 2 * WIDTH <= n; i += 2 * WIDTH) {
+      const __m256i first = sortable_keys(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&array[i])),
+          key_flip, negative_flip);
+      const __m256i second = sortable_keys(
+          _mm256_loadu_si256(
+              reinterpret_cast<const __m256i *>(&array[i + WIDTH])),
+          key_flip, negative_flip);
+      __m256i below;
+      if constexpr (sizeof(T) == 4) {
+        below = _mm256_or_si256(_mm256_cmpgt_epi32(limit, first),
+                                _mm256_cmpgt_epi32(limit, second));
+      } else {
+        below = _mm256_or_si256(_mm256_cmpgt_epi64(limit, first),
+                                _mm256_cmpgt_epi64(limit, second));
+      }
+      if (_mm256_testz_si256(below, below) == 0) {
+        for (size_t j = i; j < i + 2 * WIDTH; ++j) {
+          bound = visit(j);
+        }
+        limit = broadcast_key(bound ^ SIGN);
+      }
+    }
+    return i;
+  }
+
+  /*!
+   * @brief Key-sized bit pattern in every element of a vector
+   */
+  static __m256i broadcast_key(const uint64_t bits) {
+    if constexpr (sizeof(T) == 4) {
+      return _mm256_set1_epi32(static_cast<int>(bits));
+    } else {
+      return _mm256_set1_epi64x(static_cast<long long>(bits));
+    }
+  }
+
+  /*!
+   * @brief Apply the key transform to a whole vector of keys
+   *
+   * @param keys Raw keys
+   * @param key_flip Final flip of every key
+   * @param negative_flip Flip of negative keys
+   * @return Keys in sortable order
+   */
+  static __m256i sortable_keys(__m256i keys, const __m256i key_flip,
+                               const __m256i negative_flip) {
+    if constexpr (NEGATIVE_FLIP) {
+      __m256i negative;
+      if constexpr (sizeof(T) == 4) {
+        negative = _mm256_srai_epi32(keys, 31);
+      } else {
+        negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), keys);
+      }
+      keys = _mm256_xor_si256(keys, _mm256_and_si256(negative, negative_flip));
+    }
+    return _mm256_xor_si256(keys, key_flip);
+  }
+#endif
+
+  /*!
+   * @brief Check whether a digit position would leave the order unchanged
+   *
+   * A pass is trivial when one bucket holds all n elements, which is the
+   * case for the high digits of clustered keys such as IDs and timestamps.
+   *
+   * @param array Pointer to the elements (any element carries the digit)
+   * @param n Number of elements
+   * @param pass Index of the digit to inspect
+   * @param count Histogram of the digit position
+   * @return true if the counting pass can be skipped
+   */
+  bool is_trivial_pass(const T *array, const size_t n, const size_t pass,
+                       const size_t *count) const {
+    return count[digit_at(array[0], pass)] == n;
+  }
+
+  /*!
+   * @brief Decide whether the counting passes use write-combining scatter
+   *
+   * @param n Number of elements
+   * @return true if the scatter should stage and stream cache lines
+   */
+  bool use_write_combining(const size_t n) const {
+    if (!can_write_combine()) {
+      return false; // Elements do not tile a line or staging would thrash
+    }
+    switch (scatter_mode_) {
+    case ScatterMode::WRITE_COMBINING:
+      return true;
+    case ScatterMode::AUTO:
+      return n * sizeof(T) >= STREAMING_THRESHOLD_BYTES;
+    default:
+      return false;
+    }
+  }
+
+  /*!
+   * @brief Count the digits an MSB-first sort has to partition on
+   *
+   * @param array Pointer to the elements
+   * @param n Number of elements
+   * @param histograms Histograms of every digit position
+   * @return Number of low digits left once the leading digits shared by
+   *         every key are dropped
+   */
+  size_t significant_passes(const T *array, const size_t n,
+                            const size_t *histograms) const {
+    size_t passes = PASS_COUNT;
+    while (passes > 0 &&
+           is_trivial_pass(array, n, passes - 1,
+                           &histograms[(passes - 1) * RADIX_BASE])) {
+      --passes;
+    }
+    return passes;
+  }
+
+  /*!
+   * @brief Counting sort implementation for a single digit position
+   *
+   * @param source Pointer to the elements to be distributed
+   * @param destination Buffer receiving the elements ordered by this digit
+   * @param sourceValues Payload of the source elements, moved along
+   * @param destinationValues Buffer receiving the payload
+   * @param n Number of elements
+   * @param pass Index of the digit to sort by
+   * @param count Histogram of the digit position, consumed by this pass
+   * @param staging Staging area to write-combine the scatter, or null
+   */
+  template <typename V>
+  void counting_sort_digit(const T *source, T *destination, V *source_values,
+                           V *destination_values, const size_t n,
+                           const size_t pass, size_t *count,
+                           StagingLine *staging) {
+    // Convert counts to starting positions (exclusive prefix sum)
+    size_t position = 0;
+    for (size_t i = 0; i < RADIX_BASE; ++i) {
+      size_t bucket_size = count[i];
+      count[i] = position;
+      position += bucket_size;
+    }
+
+    scatter_digit(source, destination, source_values, destination_values, n,
+                  pass, count, staging);
+  }
+
+  /*!
+   * @brief Move elements to the output positions of their digit
+   *
+   * @param source Pointer to the elements to be distributed
+   * @param destination Buffer receiving the elements ordered by this digit
+   * @param sourceValues Payload of the source elements, moved along
+   * @param destinationValues Buffer receiving the payload
+   * @param n Number of elements
+   * @param pass Index of the digit to sort by
+   * @param position Next output index of every bucket, advanced in place
+   * @param staging Staging area to write-combine the scatter, or null
+   */
+  template <typename V>
+  void scatter_digit(const T *source, T *destination, V *source_values,
+                     V *destination_values, const size_t n, const size_t pass,
+                     size_t *position, StagingLine *staging) {
+    // Staged slots map onto destination lines only if T-aligned
+    if (staging != nullptr &&
+        reinterpret_cast<uintptr_t>(destination) % sizeof(T) == 0) {
+      scatter_write_combining(source, destination, source_values,
+                              destination_values, n, pass, position, staging);
+      return;
+    }
+
+    // Build output array front to back for stability
+    for (size_t i = 0; i < n; ++i) {
+      size_t output_pos = position[digit_at(source[i], pass)]++;
+      std::memcpy(&destination[output_pos], &source[i], sizeof(T));
+      if constexpr (HAS_VALUES<V>) {
+        destination_values[output_pos] = std::move(source_values[i]);
+      }
+    }
+  }
+
+  /*!
+   * @brief Scatter through per-bucket cache-line buffers
+   *
+   * Each bucket collects elements in a line-sized buffer that mirrors the
+   * destination line it belongs to. Complete lines are written with
+   * non-temporal stores, so the scatter neither reads destination lines
+   * into the cache nor touches a new page for every element. Partial lines
+   * at the bucket boundaries are copied normally. A payload is scattered
+   * directly, since its lines would not line up with the key lines.
+   *
+   * @param source Pointer to the elements to be distributed
+   * @param destination Buffer receiving the elements ordered by this digit
+   * @param sourceValues Payload of the source elements, moved along
+   * @param destinationValues Buffer receiving the payload
+   * @param n Number of elements
+   * @param pass Index of the digit to sort by
+   * @param position Next output index of every bucket, advanced in place
+   * @param lines Staging area of STAGING_LINES lines
+   */
+  template <typename V>
+  void scatter_write_combining(const T *source, T *destination,
+                               V *source_values, V *destination_values,
+                               const size_t n, const size_t pass,
+                               size_t *position, StagingLine *lines) {
+    constexpr size_t ELEMENTS = LINE_ELEMENTS == 0 ? 1 : LINE_ELEMENTS;
+    size_t *staged = reinterpret_cast<size_t *>(lines + RADIX_BASE);
+    std::fill(staged, staged + RADIX_BASE, size_t(0));
+
+    auto line_slot = [destination](const size_t index) {
+      return (reinterpret_cast<uintptr_t>(&destination[index]) %
+              CACHE_LINE_SIZE) /
+             sizeof(T);
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+      const size_t digit = digit_at(source[i], pass);
+      const size_t slot = line_slot(position[digit]);
+      std::memcpy(&lines[digit].bytes[slot * sizeof(T)], &source[i],
+                  sizeof(T));
+      if constexpr (HAS_VALUES<V>) {
+        destination_values[position[digit]] = std::move(source_values[i]);
+      }
+      ++position[digit];
+      ++staged[digit];
+
+      if (slot == ELEMENTS - 1) {
+        T *line_start = &destination[position[digit] - staged[digit]];
+        if (staged[digit] == ELEMENTS) {
+          stream_line(line_start, lines[digit]);
+        } else {
+          // First line of the bucket begins mid-line
+          std::memcpy(line_start,
+                      &lines[digit].bytes[(slot + 1 - staged[digit]) *
+                                          sizeof(T)],
+                      staged[digit] * sizeof(T));
+        }
+        staged[digit] = 0;
+      }
+    }
+
+    // Flush the trailing partial line of every bucket
+    for (size_t digit = 0; digit < RADIX_BASE; ++digit) {
+      if (staged[digit] != 0) {
+        const size_t start = position[digit] - staged[digit];
+        std::memcpy(&destination[start],
+                    &lines[digit].bytes[line_slot(start) * sizeof(T)],
+                    staged[digit] * sizeof(T));
+      }
+    }
+
+#ifdef UNIVERSAL_RADIX_SORT_HAS_SSE2
+    _mm_sfence(); // Order the streamed lines before later reads
+#endif
+  }
+
+  /*!
+   * @brief Write one full staged line to a line-aligned destination
+   *
+   * @param destination Line-aligned address in the output buffer
+   * @param line Staged elements
+   */
+  static void stream_line(T *destination, const StagingLine &line) {
+#ifdef UNIVERSAL_RADIX_SORT_HAS_SSE2
+    __m128i *target = reinterpret_cast<__m128i *>(destination);
+    const __m128i *staged = reinterpret_cast<const __m128i *>(line.bytes);
+    for (size_t i = 0; i < CACHE_LINE_SIZE / sizeof(__m128i); ++i) {
+      _mm_stream_si128(&target[i], _mm_load_si128(&staged[i]));
+    }
+#else
+    std::memcpy(destination, line.bytes, CACHE_LINE_SIZE);
+#endif
+  }
+
+  /*!
+   * @brief Number of threads to sort n elements with
+   *
+   * @param n Number of elements
+   * @return 1 for sequential execution, otherwise the thread count capped
+   *         so that every thread gets at least MIN_PARALLEL_CHUNK elements
+   */
+  size_t worker_count(const size_t n) const {
+    if (execution_ == Execution::SEQUENTIAL) {
+      return 1;
+    }
+    size_t threads = thread_pool_ ? thread_pool_->size() : thread_count_;
+    if (threads == 0) {
+      threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return std::max(size_t(1), std::min(threads, n / MIN_PARALLEL_CHUNK));
+  }
+
+  /*!
+   * @brief First element of a thread's block when n elements are split
+   *
+   * @param n Number of elements
+   * @param threads Number of blocks
+   * @param thread Block index, threads for the end of the last block
+   */
+  static size_t block_begin(const size_t n, const size_t threads,
+                            const size_t thread) {
+    return thread == threads ? n : n / threads * thread;
+  }
+
+  /*!
+   * @brief Run task(0) to task(tasks - 1) on the thread pool
+   *
+   * Starts a pool of thread_count_ threads if none is set.
+   *
+   * @param tasks Number of tasks
+   * @param task Callable taking the task index
+   */
+  template <typename Task>
+  void run_parallel(const size_t tasks, const Task &task) {
+    if (!thread_pool_) {
+      thread_pool_ = std::make_shared<ThreadPool>(thread_count_);
+    }
+    thread_pool_->run(tasks, task);
+  }
+
+  /*!
+   * @brief Stable counting pass with threads owning fixed blocks
+   *
+   * Each thread counts the digits of its block of the source. A prefix sum
+   * over (bucket, thread) then hands each thread a private output range per
+   * bucket, placed after the ranges of lower threads, and the threads
+   * scatter concurrently with no shared counters. Equal digits keep their
+   * block order and within a block their element order, so the result is
+   * the same for any thread count.
+   *
+   * @param source Pointer to the elements to be distributed
+   * @param destination Buffer receiving the elements ordered by this digit
+   * @param sourceValues Payload of the source elements, moved along
+   * @param destinationValues Buffer receiving the payload
+   * @param n Number of elements
+   * @param pass Index of the digit to sort by
+   * @param threads Number of threads, at least 2
+   * @param offsets threads * RADIX_BASE counters
+   * @param staging Staging areas of all threads to write-combine, or null
+   */
+  template <typename V>
+  void parallel_counting_pass(const T *source, T *destination,
+                              V *source_values, V *destination_values,
+                              const size_t n, const size_t pass,
+                              const size_t threads, size_t *offsets,
+                              StagingLine *staging) {
+    run_parallel(threads, [&](const size_t thread) {
+      size_t *count = &offsets[thread * RADIX_BASE];
+      std::fill(count, count + RADIX_BASE, size_t(0));
+      const size_t end = block_begin(n, threads, thread + 1);
+      for (size_t i = block_begin(n, threads, thread); i < end; ++i) {
+        count[digit_at(source[i], pass)]++;
+      }
+    });
+
+    // Bucket-major prefix sum: thread t writes bucket b after threads < t
+    size_t position = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      for (size_t thread = 0; thread < threads; ++thread) {
+        const size_t bucket_size = offsets[thread * RADIX_BASE + bucket];
+        offsets[thread * RADIX_BASE + bucket] = position;
+        position += bucket_size;
+      }
+    }
+
+    run_parallel(threads, [&](const size_t thread) {
+      const size_t begin = block_begin(n, threads, thread);
+      scatter_digit(source + begin, destination,
+                    values_at(source_values, begin), destination_values,
+                    block_begin(n, threads, thread + 1) - begin, pass,
+                    &offsets[thread * RADIX_BASE],
+                    staging ? staging + thread * STAGING_LINES : nullptr);
+    });
+  }
+
+  /*!
+   * @brief Stable LSB-first radix sort with threads owning fixed blocks
+   *
+   * Every pass is a parallel_counting_pass, so the result is the same for
+   * any thread count.
+   *
+   * @param array Elements to sort, receives the result
+   * @param scratch Buffer of n elements
+   * @param values Payload of array, moved along
+   * @param scratchValues Payload buffer of n values
+   * @param n Number of elements
+   * @param histograms Histograms of every digit position of array
+   * @param threads Number of threads, at least 2
+   * @param staging Staging areas of all threads to write-combine, or null
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename V>
+  void parallel_lsd_sort(T *array, T *scratch, V *values, V *scratch_values,
+                         const size_t n, const size_t *histograms,
+                         const size_t threads, StagingLine *staging,
+                         SortWorkspace &workspace) {
+    SortWorkspace::Array<size_t> offsets(workspace, threads * RADIX_BASE);
+    T *source = array;
+    T *destination = scratch;
+    V *source_values = values;
+    V *destination_values = scratch_values;
+
+    for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+      if (is_trivial_pass(source, n, pass, &histograms[pass * RADIX_BASE])) {
+        continue; // Every element shares this digit, order is unchanged
+      }
+      parallel_counting_pass(source, destination, source_values,
+                             destination_values, n, pass, threads,
+                             offsets.get(), staging);
+      std::swap(source, destination);
+      std::swap(source_values, destination_values);
+    }
+
+    // After an odd number of passes the result lives in the scratch buffer
+    if (source != array) {
+      run_parallel(threads, [&](const size_t thread) {
+        const size_t begin = block_begin(n, threads, thread);
+        const size_t end = block_begin(n, threads, thread + 1);
+        std::memcpy(array + begin, source + begin, (end - begin) * sizeof(T));
+        if constexpr (HAS_VALUES<V>) {
+          std::move(source_values + begin, source_values + end,
+                    values + begin);
+        }
+      });
+    }
+  }
+
+  /*!
+   * @brief Stable MSB-first radix sort on a work-stealing scheduler
+   *
+   * The threads partition the whole array on its top digit together, like
+   * one parallel LSD pass. Every resulting bucket becomes a task, and the
+   * tasks are spread over per-thread deques. A worker partitions a large
+   * task on its next digit and pushes the sub-buckets back as tasks;
+   * idle workers steal them, so one hot bucket is split up instead of
+   * serializing the tail. Tasks below PARALLEL_MSD_SPLIT run msd_sort.
+   *
+   * @param array Elements to sort, receives the result
+   * @param scratch Buffer of n elements
+   * @param values Payload of array, moved along
+   * @param scratchValues Payload buffer of n values
+   * @param n Number of elements
+   * @param passes Number of low digits left, at least 1
+   * @param histograms Histograms of every digit position of array
+   * @param threads Number of threads, at least 2
+   * @param staging Staging areas to write-combine the top level, or null
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename V>
+  void parallel_msd_sort(T *array, T *scratch, V *values, V *scratch_values,
+                         const size_t n, const size_t passes,
+                         const size_t *histograms, const size_t threads,
+                         StagingLine *staging, SortWorkspace &workspace) {
+    const size_t pass = passes - 1;
+    SortWorkspace::Array<size_t> offsets(workspace, threads * RADIX_BASE);
+    SortWorkspace::Array<size_t> counts(workspace,
+                                        threads * PASS_COUNT * RADIX_BASE);
+    // Only buckets of PARALLEL_MSD_SPLIT elements are queued below the top
+    // level, which bounds the tasks queued at once
+    detail::WorkStealingQueue<MsdTask<V>> queue(
+        threads, RADIX_BASE + n / PARALLEL_MSD_SPLIT, workspace);
+    parallel_counting_pass(array, scratch, values, scratch_values, n, pass,
+                           threads, offsets.get(), staging);
+
+    // Hand the buckets out round-robin; single elements go straight back
+    const size_t *count = &histograms[pass * RADIX_BASE];
+    size_t start = 0;
+    size_t next_worker = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      const size_t size = count[bucket];
+      if (size == 1) {
+        array[start] = scratch[start];
+        if constexpr (HAS_VALUES<V>) {
+          values[start] = std::move(scratch_values[start]);
+        }
+      } else if (size > 1) {
+        queue.push(next_worker, {scratch + start, array + start,
+                                 values_at(scratch_values, start),
+                                 values_at(values, start), size, pass, true});
+        next_worker = (next_worker + 1) % threads;
+      }
+      start += size;
+    }
+
+    run_parallel(threads, [&](const size_t worker) {
+      size_t *worker_counts = &counts[worker * PASS_COUNT * RADIX_BASE];
+      MsdTask<V> task;
+      try {
+        while (!queue.done()) {
+          if (!queue.pop(worker, task)) {
+            std::this_thread::yield();
+            continue;
+          }
+          run_msd_task(queue, worker, task, worker_counts);
+          queue.finish();
+        }
+      } catch (...) {
+        queue.cancel();
+        throw;
+      }
+    });
+  }
+
+  /*!
+   * @brief Run one task of a parallel MSD sort
+   *
+   * @param queue Scheduler receiving the sub-buckets
+   * @param worker Index of the running worker
+   * @param task Bucket to sort
+   * @param counts The worker's PASS_COUNT * RADIX_BASE counters
+   */
+  template <typename V>
+  void run_msd_task(detail::WorkStealingQueue<MsdTask<V>> &queue, const size_t worker,
+                    const MsdTask<V> &task, size_t *counts) {
+    if (task.n < PARALLEL_MSD_SPLIT) {
+      msd_sort(task.data, task.scratch, task.data_values, task.scratch_values,
+               task.n, task.passes, task.into_scratch, counts, nullptr);
+      return;
+    }
+
+    // Skip the digits shared by the whole bucket, as msd_sort does
+    size_t passes = task.passes;
+    size_t *count = nullptr;
+    while (passes > 0) {
+      count = &counts[(passes - 1) * RADIX_BASE];
+      std::fill(count, count + RADIX_BASE, size_t(0));
+      for (size_t i = 0; i < task.n; ++i) {
+        count[digit_at(task.data[i], passes - 1)]++;
+      }
+      if (!is_trivial_pass(task.data, task.n, passes - 1, count)) {
+        break;
+      }
+      --passes;
+    }
+
+    if (passes == 0) {
+      if (task.into_scratch) {
+        std::memcpy(task.scratch, task.data, task.n * sizeof(T));
+        if constexpr (HAS_VALUES<V>) {
+          std::move(task.data_values, task.data_values + task.n,
+                    task.scratch_values);
+        }
+      }
+      return;
+    }
+
+    // Partition into scratch; count[b] becomes the end of bucket b
+    const size_t pass = passes - 1;
+    counting_sort_digit(task.data, task.scratch, task.data_values,
+                        task.scratch_values, task.n, pass, count, nullptr);
+
+    size_t start = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      const size_t end = count[bucket];
+      if (end - start == 1) {
+        if (!task.into_scratch) {
+          task.data[start] = task.scratch[start];
+          if constexpr (HAS_VALUES<V>) {
+            task.data_values[start] = std::move(task.scratch_values[start]);
+          }
+        }
+      } else if (end - start >= PARALLEL_MSD_SPLIT) {
+        queue.push(worker, {task.scratch + start, task.data + start,
+                            values_at(task.scratch_values, start),
+                            values_at(task.data_values, start), end - start,
+                            pass, !task.into_scratch});
+      } else if (end > start) {
+        // Small buckets use counter levels below pass, which this loop
+        // does not read
+        msd_sort(task.scratch + start, task.data + start,
+                 values_at(task.scratch_values, start),
+                 values_at(task.data_values, start), end - start, pass,
+                 !task.into_scratch, counts, nullptr);
+      }
+      start = end;
+    }
+  }
+
+  /*!
+   * @brief Check whether sort() takes the lexicographic string path
+   *
+   * MSB-first sorting of UNSIGNED_OR_STRING data compares fixed-length
+   * strings; numeric key types always use the numeric digit engines.
+   */
+  bool is_string_sort() const {
+    if constexpr (radix_key_traits<T>::is_numeric) {
+      return false;
+    } else {
+      return data_type_ == DataType::UNSIGNED_OR_STRING &&
+             processing_order_ == ProcessingOrder::MSB_FIRST;
+    }
+  }
+
+  /*!
+   * @brief Compare two elements by their transformed keys
+   *
+   * @param a First element
+   * @param b Second element
+   * @param passes Number of low digits that still differ, for byte keys
+   * @return true if a orders before b
+   */
+  bool key_less(const T &a, const T &b, const size_t passes) const {
+    if constexpr (NATIVE_KEY) {
+      return sortable_key(a) < sortable_key(b);
+    } else {
+      for (size_t pass = passes; pass-- > 0;) {
+        const size_t digit_a = digit_at(a, pass);
+        const size_t digit_b = digit_at(b, pass);
+        if (digit_a != digit_b) {
+          return digit_a < digit_b;
+        }
+      }
+      return false;
+    }
+  }
+
+  /*!
+   * @brief Stable insertion sort used for small MSD buckets
+   *
+   * @param array Pointer to the elements
+   * @param values Payload of the elements, moved along
+   * @param n Number of elements
+   * @param passes Number of low digits that still differ
+   */
+  template <typename V>
+  void insertion_sort(T *array, V *values, const size_t n,
+                      const size_t passes) const {
+    for (size_t i = 1; i < n; ++i) {
+      T key = array[i];
+      size_t j = i;
+      for (; j > 0 && key_less(key, array[j - 1], passes); --j) {
+        array[j] = array[j - 1];
+      }
+      array[j] = key;
+      if constexpr (HAS_VALUES<V>) {
+        if (j != i) {
+          V value = std::move(values[i]);
+          std::move_backward(values + j, values + i, values + i + 1);
+          values[j] = std::move(value);
+        }
+      }
+    }
+  }
+
+  /*!
+   * @brief Stable MSB-first radix sort of one bucket
+   *
+   * Partitions the elements on the most significant remaining digit and
+   * recurses into every bucket with the next digit. The elements alternate
+   * between data and scratch on every level, so each level moves them once.
+   * Buckets of 0 or 1 elements end the recursion immediately, small
+   * buckets finish with insertion sort, and digits shared by the whole
+   * bucket are skipped without moving anything.
+   *
+   * @param data Elements to sort
+   * @param scratch Buffer of the same size as data
+   * @param dataValues Payload of data, moved along
+   * @param scratchValues Payload buffer of the same size as scratch
+   * @param n Number of elements
+   * @param passes Number of low digits left to sort by
+   * @param intoScratch true to leave the result in scratch instead of data
+   * @param counts PASS_COUNT * RADIX_BASE counters; each digit level uses
+   *               its own slice so parents keep their bucket bounds
+   * @param staging Staging area to write-combine the scatter, or null
+   */
+  template <typename V>
+  void msd_sort(T *data, T *scratch, V *data_values, V *scratch_values,
+                const size_t n, size_t passes, const bool into_scratch,
+                size_t *counts, StagingLine *staging) {
+    while (passes > 0 && n > MSD_SMALL_SORT_THRESHOLD) {
+      const size_t pass = passes - 1;
+      size_t *count = &counts[pass * RADIX_BASE];
+      std::fill(count, count + RADIX_BASE, size_t(0));
+      for (size_t i = 0; i < n; ++i) {
+        count[digit_at(data[i], pass)]++;
+      }
+
+      if (is_trivial_pass(data, n, pass, count)) {
+        --passes; // Shared digit, the bucket is its own partition
+        continue;
+      }
+
+      msd_partition(data, scratch, data_values, scratch_values, n, passes,
+                    into_scratch, counts, staging);
+      return;
+    }
+
+    if (n > 1 && passes > 0) {
+      insertion_sort(data, data_values, n, passes);
+    }
+    if (into_scratch) {
+      std::memcpy(scratch, data, n * sizeof(T));
+      if constexpr (HAS_VALUES<V>) {
+        std::move(data_values, data_values + n, scratch_values);
+      }
+    }
+  }
+
+  /*!
+   * @brief Partition a counted bucket on its top digit and recurse
+   *
+   * @param data Elements to sort
+   * @param scratch Buffer of the same size as data
+   * @param dataValues Payload of data, moved along
+   * @param scratchValues Payload buffer of the same size as scratch
+   * @param n Number of elements
+   * @param passes Number of low digits left, at least 1
+   * @param intoScratch true to leave the result in scratch instead of data
+   * @param counts Per-level counters; the slice of digit passes - 1 holds
+   *               the histogram of data and is consumed
+   * @param staging Staging area to write-combine this level, or null
+   */
+  template <typename V>
+  void msd_partition(T *data, T *scratch, V *data_values, V *scratch_values,
+                     const size_t n, const size_t passes,
+                     const bool into_scratch, size_t *counts,
+                     StagingLine *staging) {
+    const size_t pass = passes - 1;
+    size_t *count = &counts[pass * RADIX_BASE];
+
+    // Partition into scratch; count[b] becomes the end of bucket b
+    counting_sort_digit(data, scratch, data_values, scratch_values, n, pass,
+                        count, staging);
+
+    size_t start = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      const size_t end = count[bucket];
+      if (end - start == 1) {
+        if (!into_scratch) {
+          data[start] = scratch[start];
+          if constexpr (HAS_VALUES<V>) {
+            data_values[start] = std::move(scratch_values[start]);
+          }
+        }
+      } else if (end > start) {
+        msd_sort(scratch + start, data + start,
+                 values_at(scratch_values, start),
+                 values_at(data_values, start), end - start, pass,
+                 !into_scratch, counts, nullptr);
+      }
+      start = end;
+    }
+  }
+
+  /*!
+   * @brief Unstable in-place MSB-first radix sort of one bucket
+   *
+   * @param array Elements to sort
+   * @param values Payload of the elements, swapped along
+   * @param n Number of elements
+   * @param passes Number of low digits left to sort by
+   * @param counts Per-level histograms, PASS_COUNT * RADIX_BASE counters
+   * @param heads Per-level bucket write cursors, same layout as counts
+   */
+  template <typename V>
+  void inplace_msd_sort(T *array, V *values, const size_t n, size_t passes,
+                        size_t *counts, size_t *heads) {
+    while (passes > 0 && n > MSD_SMALL_SORT_THRESHOLD) {
+      const size_t pass = passes - 1;
+      size_t *count = &counts[pass * RADIX_BASE];
+      std::fill(count, count + RADIX_BASE, size_t(0));
+      for (size_t i = 0; i < n; ++i) {
+        count[digit_at(array[i], pass)]++;
+      }
+
+      if (is_trivial_pass(array, n, pass, count)) {
+        --passes; // Shared digit, the bucket is its own partition
+        continue;
+      }
+
+      inplace_msd_partition(array, values, passes, counts, heads);
+      return;
+    }
+
+    if (n > 1 && passes > 0) {
+      insertion_sort(array, values, n, passes);
+    }
+  }
+
+  /*!
+   * @brief Permute a counted bucket in place on its top digit and recurse
+   *
+   * American flag sort: every bucket gets a write cursor, and each element
+   * not yet in its bucket is swapped into place along the permutation
+   * cycle it belongs to, so each element moves at most once per level.
+   *
+   * @param array Elements to sort, as many as the histogram counts
+   * @param values Payload of the elements, swapped along
+   * @param passes Number of low digits left, at least 1
+   * @param counts Per-level histograms; the slice of digit passes - 1
+   *               holds the histogram of array and is consumed
+   * @param heads Per-level bucket write cursors
+   */
+  template <typename V>
+  void inplace_msd_partition(T *array, V *values, const size_t passes,
+                             size_t *counts, size_t *heads) {
+    const size_t pass = passes - 1;
+    size_t *end = &counts[pass * RADIX_BASE];
+    size_t *head = &heads[pass * RADIX_BASE];
+
+    // Turn counts into bucket bounds [head[b], end[b])
+    size_t position = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      head[bucket] = position;
+      position += end[bucket];
+      end[bucket] = position;
+    }
+
+    // Walk the permutation cycles until every bucket is filled. The key in
+    // hand travels in a register while its value waits in the cycle's
+    // starting slot, so both land in the same place
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      while (head[bucket] < end[bucket]) {
+        const size_t slot = head[bucket];
+        T key = array[slot];
+        size_t digit = digit_at(key, pass);
+        while (digit != bucket) {
+          const size_t target = head[digit]++;
+          std::swap(key, array[target]);
+          if constexpr (HAS_VALUES<V>) {
+            std::swap(values[slot], values[target]);
+          }
+          digit = digit_at(key, pass);
+        }
+        array[head[bucket]++] = key;
+      }
+    }
+
+    size_t start = 0;
+    for (size_t bucket = 0; bucket < RADIX_BASE; ++bucket) {
+      if (end[bucket] - start > 1) {
+        inplace_msd_sort(array + start, values_at(values, start),
+                         end[bucket] - start, pass, counts, heads);
+      }
+      start = end[bucket];
+    }
+  }
+
+  /*!
+   * @brief Number of elements whose scratch buffers fit the budget
+   *
+   * Sorts of up to MSD_SMALL_SORT_THRESHOLD elements always fit.
+   */
+  template <typename V> size_t budget_elements() const {
+    if (memory_budget_ == 0) {
+      return SIZE_MAX;
+    }
+    const size_t element_bytes = sizeof(T) +
+                                 (HAS_VALUES<V> ? sizeof(V) : 0) +
+                                 (is_string_sort() ? 2 * sizeof(char *) : 0);
+    return std::max(memory_budget_ / element_bytes, MSD_SMALL_SORT_THRESHOLD);
+  }
+
+  /*!
+   * @brief Compare two elements in sort order
+   *
+   * @return true if a orders before b
+   */
+  bool element_less(const T &a, const T &b) const {
+    if (is_string_sort()) {
+      const char *x = reinterpret_cast<const char *>(&a);
+      const char *y = reinterpret_cast<const char *>(&b);
+      return direction_ == Direction::ASCENDING
+                 ? std::strncmp(x, y, sizeof(T)) < 0
+                 : std::strncmp(y, x, sizeof(T)) < 0;
+    }
+    return key_less(a, b, PASS_COUNT);
+  }
+
+  /*!
+   * @brief Stable sort whose scratch buffers hold at most run elements
+   *
+   * Sorts the array in runs of run elements, each with scratch buffers of
+   * its own, then merges neighbouring runs bottom-up through a buffer of
+   * at most run elements. If less memory than that is left, the merges
+   * take a smaller buffer, down to none at all.
+   *
+   * @param array Pointer to the elements
+   * @param values Payload of the elements, moved along
+   * @param n Number of elements, more than run
+   * @param run Elements per run, at least MSD_SMALL_SORT_THRESHOLD
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename V>
+  void merge_sort_runs(T *array, V *values, const size_t n, const size_t run,
+                       SortWorkspace &workspace) {
+    for (size_t begin = 0; begin < n; begin += run) {
+      sort_elements(array + begin, values_at(values, begin),
+                    std::min(run, n - begin), Stability::STABLE, workspace);
+    }
+
+    with_merge_buffer<V>(
+        std::min(run, n / 2), workspace,
+        [&](T *buffer, V *buffer_values, const size_t capacity) {
+          for (size_t width = run; width < n; width *= 2) {
+            for (size_t begin = 0; begin < n - width; begin += 2 * width) {
+              merge_adjacent(array + begin, values_at(values, begin), width,
+                             std::min(2 * width, n - begin), buffer,
+                             buffer_values, capacity);
+            }
+          }
+        });
+  }
+
+  /*!
+   * @brief Run merges with the largest buffer memory allows
+   *
+   * Tries a buffer of capacity elements first, halving it whenever it
+   * cannot be allocated, down to none at all.
+   *
+   * @param capacity Preferred buffer size in elements
+   * @param workspace Scratch memory of the buffers
+   * @param merge Called with the key buffer, payload buffer and capacity
+   */
+  template <typename V, typename Merge>
+  void with_merge_buffer(size_t capacity, SortWorkspace &workspace,
+                         const Merge &merge) {
+    for (;; capacity /= 2) {
+      try {
+        SortWorkspace::Frame frame(workspace);
+        SortWorkspace::Array<T> buffer(workspace, capacity);
+        SortWorkspace::Array<V> buffer_values(workspace,
+                                              HAS_VALUES<V> ? capacity : 0);
+        merge(buffer.get(), buffer_values.get(), capacity);
+        return;
+      } catch (const std::bad_alloc &) {
+        if (capacity == 0) {
+          throw;
+        }
+      }
+    }
+  }
+
+  /*!
+   * @brief Stable merge of two neighbouring sorted runs
+   *
+   * The shorter run is moved to the buffer if it fits. Otherwise the
+   * longer run is cut in half, the matching cut of the other run is found
+   * by binary search, and rotating the middle pieces leaves two smaller
+   * merges.
+   *
+   * @param array Pointer to the runs array[0, middle) and array[middle, n)
+   * @param values Payload of the elements, moved along
+   * @param middle Length of the first run
+   * @param n Length of both runs
+   * @param buffer Buffer of capacity elements
+   * @param bufferValues Payload buffer of capacity values
+   * @param capacity Size of the buffers
+   */
+  template <typename V>
+  void merge_adjacent(T *array, V *values, const size_t middle, const size_t n,
+                      T *buffer, V *buffer_values, const size_t capacity) {
+    if (middle == 0 || middle == n ||
+        !element_less(array[middle], array[middle - 1])) {
+      return; // Already in order
+    }
+
+    if (middle <= capacity && middle <= n - middle) {
+      // Merge forward, taking equal elements from the buffered left run
+      std::copy(array, array + middle, buffer);
+      if constexpr (HAS_VALUES<V>) {
+        std::move(values, values + middle, buffer_values);
+      }
+      size_t left = 0;
+      size_t right = middle;
+      size_t out = 0;
+      while (left < middle && right < n) {
+        const bool take_right = element_less(array[right], buffer[left]);
+        if constexpr (HAS_VALUES<V>) {
+          values[out] = std::move(take_right ? values[right]
+                                             : buffer_values[left]);
+        }
+        array[out++] = take_right ? array[right++] : buffer[left++];
+      }
+      for (; left < middle; ++left, ++out) {
+        array[out] = buffer[left];
+        if constexpr (HAS_VALUES<V>) {
+          values[out] = std::move(buffer_values[left]);
+        }
+      }
+      return;
+    }
+
+    if (n - middle <= capacity) {
+      // Merge backward, placing equal elements of the right run last
+      std::copy(array + middle, array + n, buffer);
+      if constexpr (HAS_VALUES<V>) {
+        std::move(values + middle, values + n, buffer_values);
+      }
+      size_t left = middle;
+      size_t right = n - middle;
+      size_t out = n;
+      while (left > 0 && right > 0) {
+        const bool take_left = element_less(buffer[right - 1], array[left - 1]);
+        --out;
+        if constexpr (HAS_VALUES<V>) {
+          values[out] = std::move(take_left ? values[left - 1]
+                                            : buffer_values[right - 1]);
+        }
+        array[out] = take_left ? array[--left] : buffer[--right];
+      }
+      while (right > 0) {
+        --out;
+        --right;
+        array[out] = buffer[right];
+        if constexpr (HAS_VALUES<V>) {
+          values[out] = std::move(buffer_values[right]);
+        }
+      }
+      return;
+    }
+
+    if (n == 2) {
+      // Two elements out of order, which no cut below would split
+      std::swap(array[0], array[1]);
+      if constexpr (HAS_VALUES<V>) {
+        std::swap(values[0], values[1]);
+      }
+      return;
+    }
+
+    auto less = [this](const T &a, const T &b) { return element_less(a, b); };
+    size_t left_cut;
+    size_t right_cut;
+    if (middle > n - middle) {
+      left_cut = middle / 2;
+      right_cut = std::lower_bound(array + middle, array + n,
+                                   array[left_cut], less) - array;
+    } else {
+      right_cut = middle + (n - middle) / 2;
+      left_cut =
+          std::upper_bound(array, array + middle, array[right_cut], less) -
+          array;
+    }
+    std::rotate(array + left_cut, array + middle, array + right_cut);
+    if constexpr (HAS_VALUES<V>) {
+      std::rotate(values + left_cut, values + middle, values + right_cut);
+    }
+
+    const size_t split = left_cut + (right_cut - middle);
+    merge_adjacent(array, values, left_cut, split, buffer, buffer_values,
+                   capacity);
+    merge_adjacent(array + split, values_at(values, split), right_cut - split,
+                   n - split, buffer, buffer_values, capacity);
+  }
+
+  /*!
+   * @brief Specialized string sorting function for lexicographical ordering
+   *
+   * @param array Pointer to the array of fixed-length strings
+   * @param values Payload of the strings, moved along
+   * @param n Number of elements
+   * @param elementSize Size of each string element in bytes
+   * @param workspace Scratch memory of the sort
+   */
+  template <typename V>
+  void radix_sort_strings(char *array, V *values, const size_t n,
+                          const size_t element_size,
+                          SortWorkspace &workspace) {
+    // Compare like strncmp, which stops at the terminator
+    auto comparator = [element_size](const char *a, const char *b) {
+      return std::strncmp(a, b, element_size) < 0;
+    };
+
+    // Create array of pointers to sort
+    SortWorkspace::Array<char *> pointers(workspace, n);
+    SortWorkspace::Array<char *> scratch(workspace, n);
+    for (size_t i = 0; i < n; ++i) {
+      pointers[i] = &array[i * element_size];
+    }
+
+    // Sort pointers based on string content, keeping equal strings in
+    // their original order in both directions
+    if (direction_ == Direction::ASCENDING) {
+      merge_sort_pointers(pointers.get(), scratch.get(), n, comparator);
+    } else {
+      merge_sort_pointers(pointers.get(), scratch.get(), n,
+                          [comparator](const char *a, const char *b) {
+                            return comparator(b, a);
+                          });
+    }
+
+    // Create temporary buffer to hold sorted data
+    SortWorkspace::Array<char> temp_buffer(workspace, n * element_size);
+    for (size_t i = 0; i < n; ++i) {
+      std::memcpy(&temp_buffer[i * element_size], pointers[i], element_size);
+    }
+
+    // Gather the payload in the order of the sorted strings
+    if constexpr (HAS_VALUES<V>) {
+      SortWorkspace::Array<V> temp_values(workspace, n);
+      for (size_t i = 0; i < n; ++i) {
+        temp_values[i] =
+            std::move(values[(pointers[i] - array) / element_size]);
+      }
+      std::move(temp_values.get(), temp_values.get() + n, values);
+    }
+
+    // Copy back to original array
+    std::memcpy(array, temp_buffer.get(), n * element_size);
+  }
+
+  /*!
+   * @brief Stable bottom-up merge sort of string pointers
+   *
+   * Unlike std::stable_sort it takes its buffer from the caller, so the
+   * string path performs no allocations of its own.
+   *
+   * @param items Pointers to sort
+   * @param scratch Buffer of n pointers
+   * @param n Number of pointers
+   * @param less Strict weak ordering of the strings
+   */
+  template <typename Less>
+  static void merge_sort_pointers(char **items, char **scratch, const size_t n,
+                                  const Less &less) {
+    constexpr size_t RUN = 16; ///< Run length sorted by insertion sort
+    for (size_t begin = 0; begin < n; begin += RUN) {
+      const size_t end = std::min(begin + RUN, n);
+      for (size_t i = begin + 1; i < end; ++i) {
+        char *item = items[i];
+        size_t j = i;
+        for (; j > begin && less(item, items[j - 1]); --j) {
+          items[j] = items[j - 1];
+        }
+        items[j] = item;
+      }
+    }
+
+    // std::merge takes equal elements from the left run first
+    char **source = items;
+    char **destination = scratch;
+    for (size_t width = RUN; width < n; width *= 2) {
+      for (size_t begin = 0; begin < n; begin += 2 * width) {
+        const size_t middle = std::min(begin + width, n);
+        const size_t end = std::min(begin + 2 * width, n);
+        std::merge(source + begin, source + middle, source + middle,
+                   source + end, destination + begin, less);
+      }
+      std::swap(source, destination);
+    }
+    if (source != items) {
+      std::copy(source, source + n, items);
+    }
+  }
+};
+
+namespace detail {
+
+/*!
+ * @brief Tournament tree of losers for k-way merges
+ *
+ * Source i is the leaf at position k + i, and inner node p plays the
+ * winners of 2p and 2p + 1, keeping the loser; node 0 holds the overall
+ * winner. Once the winner's head has moved on only the matches on its
+ * path to the root are replayed, so each merged element costs log2(k)
+ * comparisons.
+ */
+class LoserTree {
+public:
+  /*!
+   * @brief Play every match
+   *
+   * @param sources Number of sources, at least 1
+   * @param beats beats(a, b) is true if the head of source a goes before
+   *              that of b; exhausted sources lose every match and ties
+   *              go to the lower index to keep the merge stable
+   */
+  template <typename Beats>
+  void build(const size_t sources, const Beats &beats) {
+    sources_ = sources;
+    tree_.assign(sources, 0);
+    std::vector<size_t> winners(sources);
+    auto winner_at = [&](const size_t position) {
+      return position >= sources ? position - sources : winners[position];
     };
+    for (size_t node = sources - 1; node >= 1; --node) {
+      const size_t left = winner_at(2 * node);
+      const size_t right = winner_at(2 * node + 1);
+      const bool left_wins = beats(left, right);
+      winners[node] = left_wins ? left : right;
+      tree_[node] = left_wins ? right : left;
+    }
+    tree_[0] = sources > 1 ? winners[1] : 0;
+  }
+
+  /*!
+   * @brief Source whose head goes first
+   */
+  size_t winner() const { return tree_[0]; }
+
+  /*!
+   * @brief Replay the winner's matches after its head changed
+   *
+   * @param beats Same ordering as passed to build()
+   */
+  template <typename Beats> void replay(const Beats &beats) {
+    size_t winner = tree_[0];
+    for (size_t node = (winner + sources_) / 2; node >= 1; node /= 2) {
+      if (beats(tree_[node], winner)) {
+        std::swap(tree_[node], winner);
+      }
+    }
+    tree_[0] = winner;
+  }
 
-    const uint64_t SIGN_BIT_MASK = 0x8000000000000000ULL;
+private:
+  size_t sources_ = 0;       ///< Number of sources
+  std::vector<size_t> tree_; ///< Loser of every match, winner in node 0
+};
 
-    for (size_t i = 0; i < n; ++i) {
-      DoubleConverter converter;
-      converter.d = array[i];
+} // namespace detail
 
-      if (is_pre_process) {
-        // Convert to sortable representation
-        if (converter.u64 & SIGN_BIT_MASK) {
-          converter.u64 = ~converter.u64; // Negative values: flip all bits
-        } else {
-          converter.u64 ^= SIGN_BIT_MASK; // Positive values: flip sign bit only
-        }
-      } else {
-        // Restore original representation
-        if (converter.u64 & SIGN_BIT_MASK) {
-          converter.u64 ^= SIGN_BIT_MASK; // Was positive: flip sign bit back
-        } else {
-          converter.u64 = ~converter.u64; // Was negative: flip all bits back
+/*!
+ * @brief External merge sort of binary files of fixed-width records
+ *
+ * Sorts files larger than memory. Run generation reads chunks that fit
+ * the memory limit, radix-sorts their keys with the record index as
+ * payload, and writes the records in that order to a temporary run file.
+ * The runs are then merged with a loser tree, streaming every run and the
+ * output through large sequential blocks. If there are more runs than
+ * blocks fit in memory, groups of runs are merged into longer runs first.
+ *
+ * Keys are compared with the sorter's data type and direction. Equal keys
+ * keep their input order if the sorter is stable.
+ *
+ * @tparam T Key type, stored at a fixed offset in every record
+ * @tparam RadixBits Digit width of the run sorter
+ *
+ * @example
+ * // 64-byte records keyed by the signed 64-bit integer at offset 8
+ * radix::ExternalRadixSort<int64_t> external(64, 8);
+ * external.set_memory_limit(size_t(1) << 30);
+ * external.sort_file("events.bin", "events.sorted.bin");
+ */
+template <typename T, unsigned RadixBits = default_radix_bits<T>::value>
+class ExternalRadixSort {
+public:
+  using Sorter = UniversalRadixSort<T, RadixBits>;
+  using ErrorCode = typename Sorter::ErrorCode;
+  using RadixException = typename Sorter::RadixException;
+
+  /*!
+   * @brief Enumeration of the phases of an external sort
+   */
+  enum class Phase {
+    RUN_GENERATION = 0, ///< Sorting chunks into run files
+    MERGE = 1           ///< Merging runs
+  };
+
+  /*!
+   * @brief Progress of an external sort, reported after every block
+   */
+  struct Progress {
+    Phase phase;            ///< Current phase
+    size_t pass;            ///< Merge pass, counted from 1; 0 for runs
+    uint64_t records_done;  ///< Records written in this phase or pass
+    uint64_t records_total; ///< Records in the file
+    size_t runs;            ///< Runs written, or runs this pass merges
+  };
+
+  /// Callback receiving progress reports
+  using ProgressCallback = std::function<void(const Progress &)>;
+
+  /*!
+   * @brief Configure the record layout
+   *
+   * @param recordSize Size of a record in bytes (default: sizeof(T))
+   * @param keyOffset Offset of the key within a record (default: 0)
+   * @param sorter Sorter of the runs, carrying data type, direction,
+   *               stability and execution (default: inferred from T)
+   * @throw RadixException if the key does not fit the record
+   */
+  explicit ExternalRadixSort(const size_t record_size = sizeof(T),
+                             const size_t key_offset = 0,
+                             const Sorter &sorter = Sorter())
+      : record_size_(record_size), key_offset_(key_offset), sorter_(sorter),
+        memory_limit_(DEFAULT_MEMORY_LIMIT) {
+    if (key_offset > record_size || record_size - key_offset < sizeof(T)) {
+      throw RadixException(ErrorCode::INVALID_ELEMENT_SIZE,
+                           "Key does not fit the record");
+    }
+  }
+
+  /*!
+   * @brief Limit the memory of run generation and merging
+   *
+   * @param bytes Memory for records, keys and I/O blocks
+   *              (default: 256 MB)
+   */
+  void set_memory_limit(const size_t bytes) { memory_limit_ = bytes; }
+
+  /*!
+   * @brief Select where run files are created
+   *
+   * @param directory Directory for run files (default: the directory of
+   *                  the output file)
+   */
+  void set_temp_directory(const std::string &directory) {
+    temp_directory_ = directory;
+  }
+
+  /*!
+   * @brief Receive progress reports
+   *
+   * @param callback Callback run on the sorting thread, empty for none
+   */
+  void set_progress(ProgressCallback callback) {
+    progress_ = std::move(callback);
+  }
+
+  /*!
+   * @brief Sort the records of a file into another file
+   *
+   * The output may be the input file itself; it is only written once the
+   * input has been read completely. Run files are removed even if the
+   * sort fails.
+   *
+   * @param input Path of the file to sort
+   * @param output Path of the sorted file, replaced if it exists
+   * @throw RadixException with FILE_IO if a file cannot be read or
+   *        written, INVALID_ELEMENT_SIZE if the input is not a whole
+   *        number of records, MEMORY_ALLOCATION if the memory limit does
+   *        not hold two records
+   */
+  void sort_file(const std::string &input, const std::string &output) {
+    std::error_code error;
+    const uint64_t bytes = std::filesystem::file_size(input, error);
+    if (error) {
+      throw RadixException(ErrorCode::FILE_IO, "Cannot read " + input);
+    }
+    if (bytes % record_size_ != 0) {
+      throw RadixException(ErrorCode::INVALID_ELEMENT_SIZE,
+                           "File size is not a multiple of the record size");
+    }
+    const uint64_t total = bytes / record_size_;
+
+    std::filesystem::path directory = temp_directory_;
+    if (directory.empty()) {
+      directory = std::filesystem::absolute(output).parent_path();
+    }
+    RunFiles runs(directory);
+    if (!generate_runs(input, output, total, runs)) {
+      return; // The input fit a single run, written straight to output
+    }
+
+    // Merge groups of runs until one merge can write the output; every
+    // run and the output get a block of at least MIN_BLOCK_BYTES
+    const size_t blocks =
+        memory_limit_ / std::max(MIN_BLOCK_BYTES, record_size_);
+    const size_t fan_in = blocks > 3 ? blocks - 1 : 2;
+    for (size_t pass = 1;; ++pass) {
+      if (runs.size() <= fan_in) {
+        merge(runs, 0, runs.size(), output, pass, total, runs.size());
+        runs.remove(0, runs.size());
+        return;
+      }
+      RunFiles merged(directory);
+      uint64_t done = 0;
+      for (size_t begin = 0; begin < runs.size(); begin += fan_in) {
+        const size_t end = std::min(begin + fan_in, runs.size());
+        const std::filesystem::path path =
+            merged.create(runs.records(begin, end));
+        done += merge(runs, begin, end, path, pass, total, runs.size(), done);
+        runs.remove(begin, end);
+      }
+      runs.swap(merged);
+    }
+  }
+
+private:
+  /// Default memory limit, 256 MB
+  static constexpr size_t DEFAULT_MEMORY_LIMIT = size_t(256) << 20;
+  /// Largest I/O block of one stream
+  static constexpr size_t MAX_BLOCK_BYTES = size_t(8) << 20;
+  /// Smallest I/O block of one stream when choosing the merge fan-in
+  static constexpr size_t MIN_BLOCK_BYTES = size_t(256) << 10;
+
+  /*!
+   * @brief Unbuffered C stream that throws on failure
+   */
+  class File {
+  public:
+    File(const std::filesystem::path &path, const char *mode)
+        : path_(path.string()), file_(std::fopen(path_.c_str(), mode)) {
+      if (file_ == nullptr) {
+        throw RadixException(ErrorCode::FILE_IO, "Cannot open " + path_);
+      }
+      // Reads and writes are whole blocks, stdio buffering only copies
+      std::setvbuf(file_, nullptr, _IONBF, 0);
+    }
+
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+
+    ~File() {
+      if (file_ != nullptr) {
+        std::fclose(file_);
+      }
+    }
+
+    void read(void *buffer, const size_t bytes) {
+      if (std::fread(buffer, 1, bytes, file_) != bytes) {
+        throw RadixException(ErrorCode::FILE_IO, "Cannot read " + path_);
+      }
+    }
+
+    void write(const void *buffer, const size_t bytes) {
+      if (std::fwrite(buffer, 1, bytes, file_) != bytes) {
+        throw RadixException(ErrorCode::FILE_IO, "Cannot write " + path_);
+      }
+    }
+
+    /*!
+     * @brief Close the stream, reporting errors of deferred writes
+     */
+    void close() {
+      std::FILE *file = file_;
+      file_ = nullptr;
+      if (std::fclose(file) != 0) {
+        throw RadixException(ErrorCode::FILE_IO, "Cannot write " + path_);
+      }
+    }
+
+  private:
+    std::string path_;
+    std::FILE *file_;
+  };
+
+  /*!
+   * @brief Run files of one generation, removed when it is destroyed
+   */
+  class RunFiles {
+  public:
+    explicit RunFiles(std::filesystem::path directory)
+        : directory_(std::move(directory)), next_(0) {
+      std::random_device entropy;
+      tag_ = std::to_string(entropy()) + "-" + std::to_string(entropy());
+    }
+
+    RunFiles(const RunFiles &) = delete;
+    RunFiles &operator=(const RunFiles &) = delete;
+
+    ~RunFiles() { remove(0, paths_.size()); }
+
+    /*!
+     * @brief Create an empty run file, to be filled with records records
+     *
+     * @return Path of the file
+     */
+    std::filesystem::path create(const uint64_t records) {
+      const std::filesystem::path path =
+          directory_ / ("radix-run-" + tag_ + "-" +
+                        std::to_string(next_++) + ".tmp");
+      File(path, "wbx").close();
+      paths_.push_back(path);
+      records_.push_back(records);
+      return path;
+    }
+
+    /*!
+     * @brief Delete the run files [begin, end)
+     */
+    void remove(const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        if (!paths_[i].empty()) {
+          std::error_code error;
+          std::filesystem::remove(paths_[i], error);
+          paths_[i].clear();
         }
       }
+    }
+
+    void swap(RunFiles &other) {
+      std::swap(directory_, other.directory_);
+      std::swap(tag_, other.tag_);
+      std::swap(next_, other.next_);
+      paths_.swap(other.paths_);
+      records_.swap(other.records_);
+    }
+
+    size_t size() const { return paths_.size(); }
+    const std::filesystem::path &path(const size_t i) const {
+      return paths_[i];
+    }
+    uint64_t records(const size_t i) const { return records_[i]; }
+
+    /*!
+     * @brief Records of the runs [begin, end)
+     */
+    uint64_t records(const size_t begin, const size_t end) const {
+      uint64_t sum = 0;
+      for (size_t i = begin; i < end; ++i) {
+        sum += records_[i];
+      }
+      return sum;
+    }
+
+  private:
+    std::filesystem::path directory_;
+    std::string tag_;     ///< Random part of the file names
+    size_t next_;         ///< Number of the next file
+    std::vector<std::filesystem::path> paths_; ///< Run files, empty if gone
+    std::vector<uint64_t> records_;            ///< Records of each run
+  };
+
+  /*!
+   * @brief Sequential reader of one run, a block at a time
+   */
+  class RunReader {
+  public:
+    RunReader(const std::filesystem::path &path, const uint64_t records,
+              const size_t record_size, const size_t block_records)
+        : file_(path, "rb"), block_(block_records * record_size),
+          record_size_(record_size), position_(0), end_(0), unread_(records) {
+      refill();
+    }
+
+    /*!
+     * @brief Current record, valid while !empty()
+     */
+    const unsigned char *record() const { return &block_[position_]; }
+
+    bool empty() const { return position_ == end_; }
+
+    /*!
+     * @brief Move to the next record
+     */
+    void advance() {
+      position_ += record_size_;
+      if (position_ == end_) {
+        refill();
+      }
+    }
+
+  private:
+    void refill() {
+      const uint64_t records =
+          std::min<uint64_t>(unread_, block_.size() / record_size_);
+      position_ = 0;
+      end_ = static_cast<size_t>(records) * record_size_;
+      unread_ -= records;
+      if (end_ > 0) {
+        file_.read(block_.data(), end_);
+      }
+    }
+
+    File file_;
+    std::vector<unsigned char> block_;
+    size_t record_size_;
+    size_t position_; ///< Offset of the current record in block_
+    size_t end_;      ///< Bytes of block_ holding records
+    uint64_t unread_; ///< Records of the run not read yet
+  };
+
+  /*!
+   * @brief Sequential writer collecting records into blocks
+   */
+  class RunWriter {
+  public:
+    RunWriter(const std::filesystem::path &path, const size_t record_size,
+              const size_t block_records)
+        : file_(path, "wb"), block_(block_records * record_size),
+          record_size_(record_size), used_(0) {}
+
+    /*!
+     * @brief Append one record
+     *
+     * @return true if a full block was written
+     */
+    bool write(const unsigned char *record) {
+      std::memcpy(&block_[used_], record, record_size_);
+      used_ += record_size_;
+      if (used_ == block_.size()) {
+        file_.write(block_.data(), used_);
+        used_ = 0;
+        return true;
+      }
+      return false;
+    }
+
+    /*!
+     * @brief Write the last block and close the file
+     */
+    void close() {
+      if (used_ > 0) {
+        file_.write(block_.data(), used_);
+        used_ = 0;
+      }
+      file_.close();
+    }
+
+  private:
+    File file_;
+    std::vector<unsigned char> block_;
+    size_t record_size_;
+    size_t used_; ///< Bytes of block_ holding records
+  };
+
+  /*!
+   * @brief Read the key of a record
+   */
+  T key_of(const unsigned char *record) const {
+    T key;
+    std::memcpy(&key, record + key_offset_, sizeof(T));
+    return key;
+  }
+
+  /*!
+   * @brief Records per I/O block when streams share the memory limit
+   *
+   * @param streams Number of streams open at once
+   */
+  size_t block_records(const size_t streams) const {
+    const size_t bytes =
+        std::min(MAX_BLOCK_BYTES, memory_limit_ / streams);
+    return std::max<size_t>(1, bytes / record_size_);
+  }
 
-      array[i] = converter.d;
+  /*!
+   * @brief Report progress if a callback is set
+   */
+  void report(const Phase phase, const size_t pass, const uint64_t done,
+              const uint64_t total, const size_t runs) const {
+    if (progress_) {
+      progress_(Progress{phase, pass, done, total, runs});
     }
   }
 
   /*!
-   * @brief Counting sort implementation for a single byte position
+   * @brief Sort memory-sized chunks of the input into run files
    *
-   * @param array Pointer to the array to be sorted
-   * @param n Number of elements
-   * @param byteIndex Index of the byte to sort by
-   * @param tempArray Temporary array for sorting
+   * @param input Path of the file to sort
+   * @param output Path of the sorted file
+   * @param total Records in the input
+   * @param runs Receives the run files
+   * @return false if the input fit one chunk and was written to output
    */
-  void counting_sort_byte(T *array, const size_t n, const size_t byte_index,
-                          T *temp_array) {
-    constexpr size_t RADIX_BASE = 256;
-    size_t count[RADIX_BASE] = {0};
-    unsigned char *bytes = reinterpret_cast<unsigned char *>(array);
+  bool generate_runs(const std::string &input, const std::string &output,
+                     const uint64_t total, RunFiles &runs) {
+    // Each record of a chunk needs its bytes, a key and an index, and the
+    // sort's scratch buffers for both
+    const size_t block = block_records(16);
+    const size_t record_bytes =
+        record_size_ + 2 * (sizeof(T) + sizeof(uint32_t));
+    const size_t block_bytes = block * record_size_;
+    const size_t available =
+        memory_limit_ > block_bytes ? memory_limit_ - block_bytes : 0;
+    if (total == 0) {
+      RunWriter(output, record_size_, block).close();
+      report(Phase::RUN_GENERATION, 0, 0, 0, 1);
+      return false;
+    }
+    const uint64_t chunk = std::min<uint64_t>(
+        {available / record_bytes, uint64_t(UINT32_MAX), total});
+    if (chunk < std::min<uint64_t>(total, 2)) {
+      throw RadixException(ErrorCode::MEMORY_ALLOCATION,
+                           "Memory limit is too small for a run");
+    }
 
-    // Count occurrences of each byte value
-    for (size_t i = 0; i < n; ++i) {
-      unsigned char byte_value = bytes[i * sizeof(T) + byte_index];
-      count[byte_value]++;
+    File file(input, "rb");
+    std::vector<unsigned char> records(static_cast<size_t>(chunk) *
+                                       record_size_);
+    std::vector<T> keys(static_cast<size_t>(chunk));
+    std::vector<uint32_t> order(static_cast<size_t>(chunk));
+    for (uint64_t done = 0; done < total;) {
+      const size_t count = static_cast<size_t>(std::min(chunk, total - done));
+      file.read(records.data(), count * record_size_);
+      for (size_t i = 0; i < count; ++i) {
+        keys[i] = key_of(&records[i * record_size_]);
+        order[i] = static_cast<uint32_t>(i);
+      }
+      if (count > 1) {
+        sorter_.sort(keys.data(), order.data(), count);
+      }
+
+      // A single chunk is the result; the input is read, so the output
+      // may replace it
+      const bool single = done == 0 && count == total;
+      const std::filesystem::path path =
+          single ? std::filesystem::path(output) : runs.create(count);
+      if (single) {
+        file.close();
+      }
+      RunWriter writer(path, record_size_, block);
+      for (size_t i = 0; i < count; ++i) {
+        writer.write(&records[size_t(order[i]) * record_size_]);
+      }
+      writer.close();
+      done += count;
+      if (single) {
+        report(Phase::RUN_GENERATION, 0, done, total, 1);
+        return false;
+      }
+      report(Phase::RUN_GENERATION, 0, done, total, runs.size());
+    }
+    return true;
+  }
+
+  /*!
+   * @brief Merge the runs [begin, end) into one file with a loser tree
+   *
+   * On equal keys the earlier run wins, which keeps the merge stable.
+   *
+   * @return Number of records written
+   */
+  uint64_t merge(const RunFiles &runs, const size_t begin, const size_t end,
+                 const std::filesystem::path &path, const size_t pass,
+                 const uint64_t total, const size_t run_count,
+                 const uint64_t done_before = 0) {
+    const size_t k = end - begin;
+    const size_t block = block_records(k + 1);
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::vector<T> heads(k);
+    readers.reserve(k);
+    for (size_t i = 0; i < k; ++i) {
+      readers.push_back(std::make_unique<RunReader>(
+          runs.path(begin + i), runs.records(begin + i), record_size_, block));
+      if (!readers[i]->empty()) {
+        heads[i] = key_of(readers[i]->record());
+      }
     }
 
-    // Convert counts to cumulative positions (prefix sum)
-    for (size_t i = 1; i < RADIX_BASE; ++i) {
-      count[i] += count[i - 1];
+    auto beats = [&](const size_t a, const size_t b) {
+      if (readers[a]->empty() || readers[b]->empty()) {
+        return !readers[a]->empty();
+      }
+      if (sorter_.precedes(heads[a], heads[b])) {
+        return true;
+      }
+      return !sorter_.precedes(heads[b], heads[a]) && a < b;
+    };
+
+    detail::LoserTree tree;
+    tree.build(k, beats);
+    RunWriter writer(path, record_size_, block);
+    uint64_t written = 0;
+    while (!readers[tree.winner()]->empty()) {
+      const size_t winner = tree.winner();
+      if (writer.write(readers[winner]->record())) {
+        report(Phase::MERGE, pass, done_before + written + 1, total,
+               run_count);
+      }
+      ++written;
+      readers[winner]->advance();
+      if (!readers[winner]->empty()) {
+        heads[winner] = key_of(readers[winner]->record());
+      }
+      tree.replay(beats);
     }
+    writer.close();
+    report(Phase::MERGE, pass, done_before + written, total, run_count);
+    return written;
+  }
 
-    // Build output array in reverse order for stability
-    unsigned char *temp_bytes = reinterpret_cast<unsigned char *>(temp_array);
-    for (size_t i = n; --i > 0;) {
-      unsigned char byte_value = bytes[i * sizeof(T) + byte_index];
-      size_t outputPos = --count[byte_value];
-      std::memcpy(&temp_bytes[outputPos * sizeof(T)], &bytes[i * sizeof(T)],
-                  sizeof(T));
+  size_t record_size_;              ///< Bytes per record
+  size_t key_offset_;               ///< Offset of the key in a record
+  Sorter sorter_;                   ///< Sorter of the runs
+  size_t memory_limit_;             ///< Memory of run generation and merging
+  std::string temp_directory_;      ///< Directory of run files, if set
+  ProgressCallback progress_;       ///< Progress callback, if set
+};
+
+/*!
+ * @brief Incremental sorter merging pushed batches into one sorted stream
+ *
+ * Every pushed batch is radix-sorted into a run at once, so sorting
+ * overlaps with ingest. While the newest run and a new batch fit in
+ * runBytes together, the batch is merged into that run while both are
+ * still in cache. Iterating merges the runs lazily with a loser tree, so
+ * the end of a window only pays for the merge, as it is consumed.
+ *
+ * Order follows the sorter's data type and direction. With a stable
+ * sorter equal keys come out in the order they were pushed.
+ *
+ * @tparam T Key type
+ * @tparam RadixBits Digit width of the batch sorter
+ *
+ * @example
+ * radix::StreamingRadixSorter<uint64_t> stream;
+ * for (auto &batch : window) stream.push(batch);
+ * for (uint64_t key : stream) emit(key);
+ * stream.clear(); // Next window
+ */
+template <typename T, unsigned RadixBits = default_radix_bits<T>::value>
+class StreamingRadixSorter {
+public:
+  using Sorter = UniversalRadixSort<T, RadixBits>;
+
+  /*!
+   * @brief Single-pass iterator over the merged runs
+   *
+   * Iterators share the merge state of their sorter: incrementing one
+   * advances all, and begin() restarts the merge. Pushing or clearing
+   * invalidates them.
+   */
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    Iterator() : owner_(nullptr) {}
+
+    reference operator*() const { return owner_->head(); }
+    pointer operator->() const { return &owner_->head(); }
+
+    Iterator &operator++() {
+      if (!owner_->advance()) {
+        owner_ = nullptr; // Now equal to end()
+      }
+      return *this;
     }
 
-    // Copy sorted elements back to original array
-    std::memcpy(array, temp_array, n * sizeof(T));
+    bool operator==(const Iterator &other) const {
+      return owner_ == other.owner_;
+    }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+  private:
+    friend class StreamingRadixSorter;
+    explicit Iterator(StreamingRadixSorter *owner) : owner_(owner) {}
+
+    StreamingRadixSorter *owner_; ///< Sorter being merged, null at the end
+  };
+
+  /*!
+   * @brief Create an empty stream
+   *
+   * @param sorter Sorter of the batches, carrying data type, direction and
+   *               stability; it sorts with a workspace of the stream's own
+   *               (default: inferred from T)
+   * @param runBytes Largest run that batches are merged into on push
+   *                 (default: 1 MB, about the size of an L2 cache)
+   */
+  explicit StreamingRadixSorter(const Sorter &sorter = Sorter(),
+                                const size_t run_bytes = DEFAULT_RUN_BYTES)
+      : sorter_(sorter), run_bytes_(run_bytes), size_(0) {
+    sorter_.set_workspace(workspace_);
   }
 
+  StreamingRadixSorter(const StreamingRadixSorter &) = delete;
+  StreamingRadixSorter &operator=(const StreamingRadixSorter &) = delete;
+
   /*!
-   * @brief Specialized string sorting function for lexicographical ordering
+   * @brief Sort a batch into a run
    *
-   * @param array Pointer to the array of fixed-length strings
-   * @param n Number of elements
-   * @param elementSize Size of each string element in bytes
+   * @param keys Pointer to the batch
+   * @param n Number of keys
+   * @throw RadixException if sorting fails
    */
-  void radix_sort_strings(char *array, const size_t n,
-                          const size_t element_size) {
-    // Use std::sort with custom comparator for proper string sorting
-    auto comparator = [element_size](const char *a, const char *b) {
-      return std::strncmp(a, b, element_size) < 0;
-    };
+  void push(const T *keys, const size_t n) {
+    if (n > 0) {
+      push(std::vector<T>(keys, keys + n));
+    }
+  }
 
-    // Create array of pointers to sort
-    std::vector<char *> pointers;
-    pointers.reserve(n);
-    for (size_t i = 0; i < n; ++i) {
-      pointers.push_back(&array[i * element_size]);
+  /*!
+   * @brief Sort a batch into a run, taking over its storage
+   *
+   * @param batch Keys to add; move it in to avoid a copy
+   * @throw RadixException if sorting fails
+   */
+  void push(std::vector<T> batch) {
+    if (batch.empty()) {
+      return;
     }
+    sorter_.sort(batch);
+    size_ += batch.size();
 
-    // Sort pointers based on string content
-    if (direction_ == Direction::ASCENDING) {
-      std::sort(pointers.begin(), pointers.end(), comparator);
+    if (!runs_.empty() &&
+        (runs_.back().size() + batch.size()) * sizeof(T) <= run_bytes_) {
+      // The newest run is small and still cached: merge the batch into it,
+      // with the run's keys first on ties
+      std::vector<T> &run = runs_.back();
+      merged_.resize(run.size() + batch.size());
+      std::merge(run.begin(), run.end(), batch.begin(), batch.end(),
+                 merged_.begin(), [this](const T &a, const T &b) {
+                   return sorter_.precedes(a, b);
+                 });
+      run.swap(merged_);
     } else {
-      std::sort(pointers.begin(), pointers.end(),
-                [comparator](const char *a, const char *b) {
-                  return !comparator(a, b) && a != b;
-                });
+      runs_.push_back(std::move(batch));
     }
+    cursors_.clear(); // Iterators are invalidated
+  }
 
-    // Create temporary buffer to hold sorted data
-    std::vector<char> temp_buffer(n * element_size);
-    for (size_t i = 0; i < n; ++i) {
-      std::memcpy(&temp_buffer[i * element_size], pointers[i], element_size);
+  /*!
+   * @brief Start merging the runs
+   *
+   * @return Iterator at the first key, or end() if the stream is empty
+   */
+  Iterator begin() {
+    if (size_ == 0) {
+      return end();
+    }
+    cursors_.assign(runs_.size(), 0);
+    heads_.resize(runs_.size());
+    for (size_t run = 0; run < runs_.size(); ++run) {
+      heads_[run] = runs_[run].data();
     }
+    tree_.build(runs_.size(), beats());
+    return Iterator(this);
+  }
 
-    // Copy back to original array
-    std::memcpy(array, temp_buffer.data(), n * element_size);
+  /*!
+   * @brief Iterator past the last key
+   */
+  Iterator end() { return Iterator(); }
+
+  /*!
+   * @brief Drop all runs to start the next window
+   */
+  void clear() {
+    runs_.clear();
+    cursors_.clear();
+    size_ = 0;
+  }
+
+  /*!
+   * @brief Number of keys pushed since the last clear()
+   */
+  size_t size() const { return size_; }
+
+  /*!
+   * @brief Number of sorted runs the iterator merges
+   */
+  size_t run_count() const { return runs_.size(); }
+
+private:
+  /// Default largest run that batches are merged into on push, 1 MB
+  static constexpr size_t DEFAULT_RUN_BYTES = size_t(1) << 20;
+
+  /*!
+   * @brief Match ordering of the loser tree
+   */
+  auto beats() const {
+    return [this](const size_t a, const size_t b) {
+      if (heads_[a] == nullptr || heads_[b] == nullptr) {
+        return heads_[a] != nullptr;
+      }
+      if (sorter_.precedes(*heads_[a], *heads_[b])) {
+        return true;
+      }
+      return !sorter_.precedes(*heads_[b], *heads_[a]) && a < b;
+    };
   }
 
   /*!
-   * @brief Reverse an array to change sort order
+   * @brief Next key of the merge
+   */
+  const T &head() const { return *heads_[tree_.winner()]; }
+
+  /*!
+   * @brief Move past the next key of the merge
    *
-   * @param array Pointer to the array to be reversed
-   * @param n Number of elements
+   * @return false if the merge is exhausted
    */
-  void reverse_array(T *array, const size_t n) {
-    for (size_t i = 0; i < n / 2; ++i) {
-      std::swap(array[i], array[n - 1 - i]);
-    }
+  bool advance() {
+    const size_t run = tree_.winner();
+    heads_[run] = ++cursors_[run] < runs_[run].size()
+                      ? runs_[run].data() + cursors_[run]
+                      : nullptr;
+    tree_.replay(beats());
+    return heads_[tree_.winner()] != nullptr;
   }
+
+  SortWorkspace workspace_;         ///< Scratch memory of the batch sorts
+  Sorter sorter_;                   ///< Sorter of the batches
+  size_t run_bytes_;                ///< Largest run merged into on push
+  size_t size_;                     ///< Keys in all runs
+  std::vector<std::vector<T>> runs_; ///< Sorted runs in push order
+  std::vector<T> merged_;           ///< Buffer of merges on push
+  std::vector<size_t> cursors_;     ///< Position of the merge in each run
+  std::vector<const T *> heads_;    ///< Next key of each run, null if done
+  detail::LoserTree tree_;          ///< Merge state of the iterator
 };
 
 } // namespace radix